@@ -7,6 +7,7 @@
 
 #include "File.h"
 #include "RawClustered.h"
+#include <sstream>
 
 using namespace boost::filesystem;
 
@@ -15,12 +16,15 @@ std::map<std::string, NMX::Settings> collect_params
 
 void analyze_metrics
     (const std::set<path>& files,
-     const std::map<std::string, NMX::Settings>& params);
+     const std::map<std::string, NMX::Settings>& params,
+     size_t prefetch, size_t threads, bool fanout,
+     size_t jobs);
 
 void emulate_vmm
     (const std::set<path>& files,
      const std::map<std::string, NMX::Settings>& params,
-     int chunksize);
+     int chunksize,
+     NMX::RawVMM::Layout layout);
 
 volatile sig_atomic_t term_flag = 0;
 void term_key(int /*sig*/)
@@ -32,15 +36,20 @@ static const char USAGE[] =
     R"(nmx analyze
 
     Usage:
-    nmx_analyze PATH PARAMS [-r]
-    nmx_analyze PATH PARAMS [-r] --tovmm [--chunk size]
+    nmx_analyze PATH PARAMS [-r] [--prefetch N] [--threads N] [--fanout] [--jobs N]
+    nmx_analyze PATH PARAMS [-r] --tovmm [--chunk size] [--compact]
     nmx_analyze (-h | --help)
 
     Options:
     -h --help      Show this screen.
     -r             Recursive file search
+    --prefetch N   Read N events ahead on a background thread [default: 0]
+    --threads N    Analyze events on N worker threads [default: 1]
+    --fanout       Read each event once and analyze it for all analyses
+    --jobs N       Process N files concurrently [default: 1]
     --tovmm        Convert to emulated vmm data
-    --chunk SIZE   raw/VMM size [default: 20]
+    --chunk SIZE   raw/VMM chunk rows, 0 for automatic [default: 0]
+    --compact      write delta-encoded compact raw/VMM layout
     )";
 
 int main(int argc, char* argv[])
@@ -60,13 +69,8 @@ int main(int argc, char* argv[])
 
   bool to_vmm = args["--tovmm"].asBool();
   int chunksize {0};
-  if (to_vmm && args["SIZE"].isLong())
-    chunksize = args["SIZE"].asLong();
-  if (chunksize < 1)
-    chunksize = 20;
-
-  if (to_vmm)
-    std::cout << "Saving as emulated VMM data using chunksize=" << chunksize << "\n";
+  if (to_vmm && args["--chunk"])
+    chunksize = args["--chunk"].asLong();
 
   std::cout << "Will analyse the following files:\n";
   for (auto p : files)
@@ -77,9 +81,22 @@ int main(int argc, char* argv[])
     std::cout << "   " << g.first << ":\n" << g.second.debug("      ") << "\n";
 
   if (to_vmm)
-    emulate_vmm(files, params, chunksize);
+    emulate_vmm(files, params, chunksize,
+                args["--compact"].asBool() ? NMX::RawVMM::Layout::compact
+                                           : NMX::RawVMM::Layout::plain);
   else
-    analyze_metrics(files, params);
+  {
+    size_t prefetch {0};
+    if (args["--prefetch"])
+      prefetch = args["--prefetch"].asLong();
+    size_t threads {1};
+    if (args["--threads"])
+      threads = args["--threads"].asLong();
+    size_t jobs {1};
+    if (args["--jobs"])
+      jobs = args["--jobs"].asLong();
+    analyze_metrics(files, params, prefetch, threads, args["--fanout"].asBool(), jobs);
+  }
 
   return 0;
 }
@@ -105,74 +122,140 @@ std::map<std::string, NMX::Settings> collect_params(std::string file_path)
   return params;
 }
 
-void analyze_metrics(const std::set<path>& files,
-                     const std::map<std::string, NMX::Settings>& params)
+size_t analyze_file(const path& f, std::string counter,
+                    const std::map<std::string, NMX::Settings>& params,
+                    size_t prefetch, size_t threads, bool fanout,
+                    bool show_progress, std::ostream& log)
 {
-  size_t fnum {1};
-  size_t total_events {0};
-  for (auto f : files)
-  {
-    auto filename = f.string();
-    std::shared_ptr<NMX::File> reader;
+  auto filename = f.string();
+  std::shared_ptr<NMX::File> reader;
 
-    try
-    {
-      if (!params.empty())
-        reader = std::make_shared<NMX::File>(filename, H5CC::Access::rw_existing);
-      else
-        reader = std::make_shared<NMX::File>(filename, H5CC::Access::r_existing);
-    }
-    catch (...)
-    {
-      printException();
-      std::cout << "Could not open file " << filename << "\n";
-      continue;
-    }
+  try
+  {
+    if (!params.empty())
+      reader = std::make_shared<NMX::File>(filename, H5CC::Access::rw_existing);
+    else
+      reader = std::make_shared<NMX::File>(filename, H5CC::Access::r_existing);
+  }
+  catch (...)
+  {
+    printException();
+    log << "Could not open file " << filename << "\n";
+    return 0;
+  }
 
-    reader->open_raw();
+  reader->set_prefetch(prefetch);
+  reader->open_raw();
 
-    if (!reader->event_count())
-      continue;
+  size_t nevents = reader->event_count();
+  if (!nevents)
+    return 0;
 
-    std::cout << "Processing file " << filename << " (" << fnum << "/" << files.size() << ")\n";
+  log << "Processing file " << filename << " (" << counter << ")\n";
 
-    total_events += reader->event_count();
+  std::shared_ptr<boost::progress_display> prog;
+  auto committed = [&](size_t)
+  {
+    if (prog)
+      ++(*prog);
+    return !term_flag;
+  };
 
+  if (fanout && !params.empty())
+  {
+    size_t numanalyzed = nevents;
     for (auto group : params)
     {
       reader->create_analysis(group.first);
       reader->load_analysis(group.first);
+      numanalyzed = std::min(numanalyzed, reader->num_analyzed());
+    }
 
-      size_t nevents = reader->event_count();
-      size_t numanalyzed = reader->num_analyzed();
+    if (numanalyzed < nevents)
+    {
+      CustomTimer timer(true);
+      if (show_progress)
+      {
+        prog = progbar(nevents, "  Analyzing " + std::to_string(params.size()) + " analyses  ");
+        (*prog) += numanalyzed;
+      }
+      reader->analyze_events(params, threads, committed);
+      if (!term_flag)
+        log << "Analysis time = " << timer.done() << "   secs/1000events=" << timer.s() / nevents * 1000 << "\n";
+    }
+    return nevents;
+  }
 
-      if (numanalyzed >= nevents)
-        continue;
+  for (auto group : params)
+  {
+    reader->create_analysis(group.first);
+    reader->load_analysis(group.first);
 
-      reader->set_parameters(group.second);
+    size_t numanalyzed = reader->num_analyzed();
 
-      CustomTimer timer(true);
-      auto prog = progbar(nevents, "  Analyzing '" + group.first + "'  ");
+    if (numanalyzed >= nevents)
+      continue;
+
+    reader->set_parameters(group.second);
+
+    CustomTimer timer(true);
+    if (show_progress)
+    {
+      prog = progbar(nevents, "  Analyzing '" + group.first + "'  ");
       (*prog) += numanalyzed;
-      for (size_t eventID = numanalyzed; eventID < nevents; ++eventID)
-      {
-        reader->analyze_event(eventID);
-        ++(*prog);
-        if (term_flag)
-          return;
-      }
-      std::cout << "Analysis time = " << timer.done() << "   secs/1000events=" << timer.s() / nevents * 1000 << "\n";
     }
-    ++fnum;
+    reader->analyze_events(numanalyzed, nevents, threads, committed);
+    if (term_flag)
+      break;
+    log << "Analysis time = " << timer.done() << "   secs/1000events=" << timer.s() / nevents * 1000 << "\n";
   }
+  return nevents;
+}
+
+void analyze_metrics(const std::set<path>& files,
+                     const std::map<std::string, NMX::Settings>& params,
+                     size_t prefetch, size_t threads, bool fanout,
+                     size_t jobs)
+{
+  size_t total_events {0};
+
+  //in parallel, per-file output is held back and printed in file order
+  std::vector<std::stringstream> logs(files.size());
+  std::vector<size_t> events(files.size(), 0);
+
+  for_each_file(files, jobs,
+                [&](size_t i, const path& f)
+  {
+    std::string counter = std::to_string(i + 1) + "/" + std::to_string(files.size());
+    if (jobs < 2)
+      events[i] = analyze_file(f, counter, params, prefetch, threads, fanout,
+                               true, std::cout);
+    else if (!term_flag)
+      events[i] = analyze_file(f, counter, params, prefetch, threads, fanout,
+                               false, logs[i]);
+  },
+                [&](size_t i, const path&)
+  {
+    std::cout << logs[i].str();
+    logs[i].str("");
+    total_events += events[i];
+    return !term_flag;
+  });
+
+  if (term_flag)
+    return;
 
   std::cout << "Processed " << total_events << " events in " << files.size() << " files\n";
 }
 
 void emulate_vmm(const std::set<path>& files,
                  const std::map<std::string, NMX::Settings>& params,
-                 int chunksize)
+                 int chunksize,
+                 NMX::RawVMM::Layout layout)
 {
+  //APV events read and reduced together
+  const size_t batch_size {256};
+
   size_t fnum {1};
   for (auto f : files)
   {
@@ -200,26 +283,54 @@ void emulate_vmm(const std::set<path>& files,
 
     std::cout << "Processing file " << filename << " (" << fnum << "/" << files.size() << ")\n";
 
+    size_t nevents = reader->event_count();
+    NMX::ChunkPolicy chunking = NMX::ChunkPolicy::automatic(nevents);
+    if (chunksize > 0)
+      chunking = NMX::ChunkPolicy::fixed_rows(chunksize);
+    std::cout << "Saving as emulated VMM data using chunking=" << chunking.debug() << "\n";
+
     for (auto group : params)
     {
-      size_t nevents = reader->event_count();
       std::string newname =
           change_extension(filename, "").string() +
           "_" + group.first + ".h5";
 
       H5CC::File outfile(newname, H5CC::Access::rw_require);
-      NMX::RawClustered writer(outfile, nevents, chunksize);
+      NMX::RawClustered writer(outfile, nevents, chunking, layout);
 
       auto prog = progbar(nevents, "  Converting to '" + newname + "'  ");
 
+      NMX::EventParams compiled(group.second);
+
+      //batches give the same maxima unless the raw data is taken as VMM
+      bool batched = (compiled.x.level != NMX::AnalysisLevel::reduced_from_vmm) &&
+                     (compiled.y.level != NMX::AnalysisLevel::reduced_from_vmm);
+
       CustomTimer timer(true);
-      for (size_t eventID = 0; eventID < nevents; ++eventID)
+      for (size_t eventID = 0; eventID < nevents; )
       {
-        auto event = reader->get_event(eventID);
-        event.set_parameters(group.second);
-        event.analyze();
-        writer.write_event(eventID, event);
-        ++(*prog);
+        if (batched)
+        {
+          auto batch = reader->get_apv_batch(eventID, batch_size);
+          if (!batch.size())
+            break;
+          auto results = batch.analyze(compiled, false);
+          for (size_t i = 0; i < batch.size(); ++i)
+          {
+            writer.write_maxima(eventID, 0, results.vmm_points(i, 0));
+            writer.write_maxima(eventID, 1, results.vmm_points(i, 1));
+            ++eventID;
+            ++(*prog);
+          }
+        }
+        else
+        {
+          auto event = reader->get_event(eventID, false);
+          event.analyze(compiled);
+          writer.write_event(eventID, event);
+          ++eventID;
+          ++(*prog);
+        }
         if (term_flag)
           return;
       }
@@ -0,0 +1,186 @@
+#include <signal.h>
+#include <random>
+#include "Filesystem.h"
+#include "ExceptionUtil.h"
+#include "custom_timer.h"
+#include "docopt.h"
+
+#include "RawVMM.h"
+
+using namespace NMX;
+using namespace std;
+using namespace boost::filesystem;
+
+struct Layout
+{
+  string name;
+  ChunkPolicy chunking;
+  RawVMM::Layout layout;
+};
+
+void benchmark(const path& file, const Layout& layout,
+               size_t eventlets, size_t random_reads, bool keep);
+
+volatile sig_atomic_t term_flag = 0;
+void term_key(int /*sig*/)
+{
+  term_flag = 1;
+}
+
+static const char USAGE[] =
+    R"(nmx_bench_layout
+
+    Compares RawVMM chunk layouts and filters by copying a raw VMM dataset
+    and timing writes, sequential reads and random reads.
+
+    Usage:
+    nmx_bench_layout PATH [--num <eventlets>] [--random <reads>] [--keep]
+    nmx_bench_layout (-h | --help)
+
+    Options:
+    -h --help           show this screen
+    --num <eventlets>   number of eventlets to copy, 0 for all [default: 0]
+    --random <reads>    number of random 100-eventlet reads [default: 1000]
+    --keep              keep copied files
+    )";
+
+int main(int argc, char* argv[])
+{
+  signal(SIGINT, term_key);
+  H5CC::exceptions_off();
+
+  auto args = docopt::docopt(USAGE, {argv+1,argv+argc}, true);
+
+  auto infile = path(args["PATH"].asString());
+  if (infile.empty())
+    return 1;
+
+  size_t num {0};
+  if (args["--num"])
+    num = args["--num"].asLong();
+
+  size_t random_reads {1000};
+  if (args["--random"])
+    random_reads = args["--random"].asLong();
+
+  bool keep = args["--keep"].asBool();
+
+  H5CC::File file;
+  RawVMM reader;
+  try
+  {
+    file = H5CC::File(infile.string(), H5CC::Access::r_existing);
+    reader = RawVMM(file);
+  }
+  catch (...)
+  {
+    printException();
+    cout << "Could not open file " << infile << "\n";
+    return 1;
+  }
+
+  size_t eventlets = reader.eventlet_count();
+  if (num && (num < eventlets))
+    eventlets = num;
+  if (!eventlets)
+  {
+    cout << "Dataset in " << infile << " empty\n";
+    return 1;
+  }
+
+  std::vector<Layout> layouts
+  {
+    {"rows20",  ChunkPolicy::fixed_rows(20), RawVMM::Layout::plain},
+    {"16k",     ChunkPolicy::fixed_bytes(16 * 1024), RawVMM::Layout::plain},
+    {"256k",    ChunkPolicy::fixed_bytes(256 * 1024), RawVMM::Layout::plain},
+    {"1M",      ChunkPolicy::fixed_bytes(1024 * 1024), RawVMM::Layout::plain},
+    {"auto",    ChunkPolicy::automatic(eventlets), RawVMM::Layout::plain},
+    {"compact", ChunkPolicy::automatic(eventlets), RawVMM::Layout::compact},
+    {"shuffle", ChunkPolicy::automatic(eventlets).filtered(0, true), RawVMM::Layout::plain},
+    {"deflate", ChunkPolicy::automatic(eventlets).filtered(4, false), RawVMM::Layout::plain},
+    {"shuffle_deflate",
+     ChunkPolicy::automatic(eventlets).filtered(4, true), RawVMM::Layout::plain},
+    {"compact_shuffle_deflate",
+     ChunkPolicy::automatic(eventlets).filtered(4, true), RawVMM::Layout::compact}
+  };
+
+  cout << "Benchmarking " << eventlets << " eventlets from " << infile << "\n";
+  for (const auto& l : layouts)
+  {
+    benchmark(infile, l, eventlets, random_reads, keep);
+    if (term_flag)
+      break;
+  }
+
+  return 0;
+}
+
+void benchmark(const path& file, const Layout& layout,
+               size_t eventlets, size_t random_reads, bool keep)
+{
+  string newname = change_extension(file, "").string() +
+      "_layout_" + layout.name + ".h5";
+
+  size_t packetsize {10000};
+  EventletPacket packet(packetsize);
+
+  double write_time {0};
+  double read_time {0};
+  double random_time {0};
+
+  try
+  {
+    H5CC::File infile(file.string(), H5CC::Access::r_existing);
+    RawVMM reader(infile);
+
+    {
+      H5CC::File outfile(newname, H5CC::Access::rw_truncate);
+      RawVMM writer(outfile, layout.chunking, layout.layout);
+      CustomTimer timer(true);
+      for (size_t i = 0; i < eventlets; i += packetsize)
+      {
+        reader.read_range(i, std::min(i + packetsize, eventlets), packet);
+        writer.write_packet(packet);
+      }
+      writer.flush();
+      write_time = timer.s();
+    }
+
+    H5CC::File outfile(newname, H5CC::Access::r_existing);
+    RawVMM copy(outfile);
+
+    CustomTimer timer(true);
+    for (size_t i = 0; i < eventlets; i += packetsize)
+      copy.read_range(i, i + packetsize, packet);
+    read_time = timer.s();
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> uni(0, eventlets - 1);
+    CustomTimer random_timer(true);
+    for (size_t i = 0; i < random_reads; ++i)
+    {
+      size_t start = uni(rng);
+      copy.read_range(start, start + 100, packet);
+    }
+    random_time = random_timer.s();
+  }
+  catch (...)
+  {
+    printException();
+    cout << "Benchmark of layout " << layout.name << " failed\n";
+    return;
+  }
+
+  auto bytes = file_size(newname);
+  if (!keep)
+    remove(newname);
+
+  cout << "  " << layout.name
+       << " (" << layout.chunking.debug() << ", "
+       << layout.chunking.rows(RawVMM::row_bytes) << " rows/chunk)\n"
+       << "     file size   = " << bytes / 1048576.0 << " MB\n"
+       << "     write       = " << write_time << " s\n"
+       << "     seq. read   = " << read_time << " s\n"
+       << "     rand. read  = " << random_time << " s for "
+       << random_reads << " reads\n";
+}
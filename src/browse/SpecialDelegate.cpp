@@ -12,6 +12,7 @@
 #include "CustomLogger.h"
 #include "SearchList.h"
 #include <QPushButton>
+#include <QLineEdit>
 
 #include "JsonH5.h"
 
@@ -125,6 +126,8 @@ QWidget *SpecialDelegate::createEditor(QWidget *parent,
       editor->setText(QString::fromStdString(menu.choice()));
       return editor;
     }
+    else if (itemData.is_string())
+      return new QLineEdit(parent);
   }
 
   if (index.data().type() == QVariant::Bool)
@@ -202,6 +205,11 @@ void SpecialDelegate::setEditorData ( QWidget *editor, const QModelIndex &index
       if (QPushButton *cb = qobject_cast<QPushButton *>(editor))
         popupSearchDialog(cb, list);
     }
+    else if (itemData.is_string())
+    {
+      if (QLineEdit *le = qobject_cast<QLineEdit *>(editor))
+        le->setText(QString::fromStdString(itemData.get<std::string>()));
+    }
   }
   else if (QSpinBox *sb = qobject_cast<QSpinBox *>(editor))
       sb->setValue(index.data().toLongLong());
@@ -224,6 +232,8 @@ void SpecialDelegate::setModelData ( QWidget *editor, QAbstractItemModel *model,
     model->setData(index, QVariant::fromValue(sb->value()), Qt::EditRole);
   else if (QPushButton *cb = qobject_cast<QPushButton *>(editor))
     model->setData(index, cb->text(), Qt::EditRole);
+  else if (QLineEdit *le = qobject_cast<QLineEdit *>(editor))
+    model->setData(index, le->text(), Qt::EditRole);
   else if (QComboBox *cb = qobject_cast<QComboBox *>(editor))
   {
     if (index.data(Qt::EditRole).canConvert<nlohmann::json>())
@@ -42,6 +42,8 @@ QVariant TableSettings::data(const QModelIndex &index, int role) const
         return QVariant::fromValue(item.get<double>());
       else if (item.is_boolean())
         return QVariant::fromValue(item.get<bool>());
+      else if (item.is_string())
+        return QString::fromStdString(item.get<std::string>());
       else if (item.count("___choice") && item.count("___options"))
       {
         H5CC::Enum<int16_t> menu = item;
@@ -125,6 +127,10 @@ bool TableSettings::setData(const QModelIndex & index, const QVariant & value, i
     {
       item = value.toBool();
     }
+    else if (item.is_string() && value.canConvert(QMetaType::QString))
+    {
+      item = value.toString().toStdString();
+    }
     else if ((item.count("___options") || item.count("___choice")) &&
              value.canConvert(QMetaType::QString))
     {
@@ -0,0 +1,564 @@
+#include "ClusterPipeline.h"
+#include "Clusterer.h"
+#include "Correlator.h"
+#include "MergeQ.h"
+#include "Prefetcher.h"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+namespace NMX {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secs_since(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void analyze_events(std::list<SimpleEvent>& events, std::vector<Event>& good)
+{
+  for (auto& event : events)
+  {
+    event.analyze(true, 3, 6);
+    if (event.good())
+      good.push_back(Event(event));
+  }
+}
+
+//consumer side, lets a producer finish after its consumer failed
+template<typename T>
+void drain(SPSCQueue<T>& queue)
+{
+  T item;
+  while (queue.pop(item)) {}
+}
+
+//as above for a queue of each stage, all at once, as one stage may only
+//finish once another has made room for their common producer
+template<typename Stage, typename T>
+void drain(std::vector<std::unique_ptr<Stage>>& stages, SPSCQueue<T> Stage::* queue)
+{
+  Backoff idle;
+  T item;
+  size_t drained {0};
+  while (drained < stages.size())
+  {
+    bool popped {false};
+    drained = 0;
+    for (auto& stage : stages)
+    {
+      if (((*stage).*queue).try_pop(item))
+        popped = true;
+      else if (((*stage).*queue).drained())
+        drained++;
+    }
+    if (popped)
+      idle.reset();
+    else if (drained < stages.size())
+      idle.wait();
+  }
+}
+
+}
+
+ClusterPipeline::ClusterPipeline(const RawVMM& reader, RawClustered& writer,
+                                 ClusterParams params)
+  : reader_(reader)
+  , writer_(writer)
+  , params_(params)
+  , read_(params.queue_depth)
+  , ordered_(params.queue_depth)
+  , clustered_(params.queue_depth)
+  , analyzed_(params.queue_depth)
+  , segmenter_(params.time_slack, params.segment_size)
+{
+  for (size_t i = 0; i < params.workers; ++i)
+    workers_.push_back(std::unique_ptr<Worker>(
+        new Worker(params.queue_depth, "segment " + std::to_string(i))));
+  if (params.split_planes && workers_.empty())
+    for (size_t i = 0; i < 2; ++i)
+      planes_.push_back(std::unique_ptr<PlaneStage>(
+          new PlaneStage(params.queue_depth, "plane " + std::to_string(i))));
+}
+
+void ClusterPipeline::run(std::function<bool(size_t)> progress)
+{
+  error_ = nullptr;
+  failed_ = false;
+
+  std::vector<std::thread> threads;
+  auto stage = [&](std::function<void()> body, std::function<void()> recover)
+  {
+    threads.push_back(std::thread(&ClusterPipeline::guard, this, body, recover));
+  };
+
+  stage([=]{ read(progress); }, [=]{ read_.close(); });
+  stage([=]{ order(); }, [=]
+  {
+    drain(read_);
+    ordered_.close();
+    for (auto& worker : workers_)
+      worker->in.close();
+    for (auto& plane : planes_)
+      plane->in.close();
+  });
+  if (workers_.empty())
+  {
+    if (planes_.empty())
+      stage([=]{ cluster(); }, [=]{ drain(ordered_); clustered_.close(); });
+    for (auto& plane : planes_)
+    {
+      PlaneStage* p = plane.get();
+      stage([=]{ cluster_plane(*p); }, [=]{ drain(p->in); p->out.close(); });
+    }
+    if (!planes_.empty())
+      stage([=]{ correlate(); }, [=]
+      {
+        drain(planes_, &PlaneStage::out);
+        clustered_.close();
+      });
+    stage([=]{ analyze(); }, [=]{ drain(clustered_); analyzed_.close(); });
+    stage([=]{ write(); }, [=]{ drain(analyzed_); });
+  }
+  else
+  {
+    for (auto& worker : workers_)
+    {
+      Worker* w = worker.get();
+      stage([=]{ segment(*w); }, [=]{ drain(w->in); w->out.close(); });
+    }
+    stage([=]{ write_segments(); }, [=]{ drain(workers_, &Worker::out); });
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  if (error_)
+    std::rethrow_exception(error_);
+}
+
+void ClusterPipeline::guard(std::function<void()> body,
+                            std::function<void()> recover)
+{
+  try
+  {
+    body();
+  }
+  catch (...)
+  {
+    {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+    failed_ = true;
+    recover();
+  }
+}
+
+void ClusterPipeline::read(std::function<bool(size_t)> progress)
+{
+  auto start = Clock::now();
+  size_t eventlet_count = reader_.eventlet_count();
+  for (size_t i = 0; i < eventlet_count; i += params_.packet_size)
+  {
+    auto busy = Clock::now();
+    EventletPacket packet(params_.packet_size);
+    {
+      std::lock_guard<std::mutex> io(io_mutex());
+      reader_.read_packet(i, packet);
+    }
+    read_stats_.items += packet.eventlets.size();
+    read_stats_.busy += secs_since(busy);
+
+    read_.push(std::move(packet));
+    if (failed_ || (progress && !progress(read_stats_.items)))
+      break;
+  }
+  read_.close();
+  read_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::order()
+{
+  auto start = Clock::now();
+  MergeQ queue(params_.latency);
+  EventletPacket packet;
+  while (read_.pop(packet))
+  {
+    auto busy = Clock::now();
+    queue.push(std::move(packet));
+    EventletPacket ready(params_.packet_size);
+    queue.pop(ready);
+    order_stats_.items += ready.eventlets.size();
+    order_stats_.busy += secs_since(busy);
+
+    deliver(std::move(ready), false);
+  }
+
+  auto busy = Clock::now();
+  EventletPacket rest(queue.size());
+  while (!queue.empty())
+    rest.add(queue.pop());
+  order_stats_.items += rest.eventlets.size();
+  order_stats_.busy += secs_since(busy);
+
+  deliver(std::move(rest), true);
+  ordered_.close();
+  for (auto& worker : workers_)
+    worker->in.close();
+  for (auto& plane : planes_)
+    plane->in.close();
+  order_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::deliver(EventletPacket&& packet, bool last)
+{
+  if (!planes_.empty())
+  {
+    if (packet.eventlets.empty())
+      return;
+    //every plane hears how far the stream has got, even if quiet
+    std::vector<EventletPacket> parts(planes_.size());
+    for (const auto& eventlet : packet.eventlets)
+      parts[eventlet.plane ? 1 : 0].add(eventlet);
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+      parts[i].time_end = std::max(parts[i].time_end, packet.time_end);
+      planes_[i]->in.push(std::move(parts[i]));
+    }
+    return;
+  }
+
+  if (workers_.empty())
+  {
+    if (!packet.eventlets.empty())
+      ordered_.push(std::move(packet));
+    return;
+  }
+
+  auto parts = segmenter_.split(std::move(packet));
+  for (size_t i = 0; i + 1 < parts.size(); ++i)
+  {
+    Chunk chunk;
+    chunk.packet = std::move(parts[i]);
+    chunk.last = true;
+    send(std::move(chunk));
+  }
+
+  Chunk chunk;
+  chunk.packet = std::move(parts.back());
+  chunk.last = last;
+  if (chunk.last || !chunk.packet.eventlets.empty())
+    send(std::move(chunk));
+}
+
+void ClusterPipeline::send(Chunk&& chunk)
+{
+  bool last = chunk.last;
+  workers_[segment_worker_]->in.push(std::move(chunk));
+  if (last)
+    segment_worker_ = (segment_worker_ + 1) % workers_.size();
+}
+
+void ClusterPipeline::cluster()
+{
+  auto start = Clock::now();
+  Clusterer clusterer(params_.time_slack, params_.strip_slack,
+                      params_.correlation_slack, params_.correlation_bound);
+  EventletPacket packet;
+  while (ordered_.pop(packet))
+  {
+    auto busy = Clock::now();
+    for (const auto& eventlet : packet.eventlets)
+      clusterer.insert(eventlet);
+    cluster_stats_.items += packet.eventlets.size();
+    std::list<SimpleEvent> events;
+    if (clusterer.events_ready())
+      events = clusterer.pop_events();
+    cluster_stats_.busy += secs_since(busy);
+
+    if (!events.empty())
+      clustered_.push(std::move(events));
+  }
+
+  auto busy = Clock::now();
+  clusterer.dump();
+  auto events = clusterer.pop_events();
+  cluster_stats_.busy += secs_since(busy);
+
+  if (!events.empty())
+    clustered_.push(std::move(events));
+  clustered_.close();
+  cluster_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::cluster_plane(PlaneStage& plane)
+{
+  auto start = Clock::now();
+  PlaneClusterer clusterer(params_.time_slack, params_.strip_slack);
+  EventletPacket packet;
+  while (plane.in.pop(packet))
+  {
+    auto busy = Clock::now();
+    for (const auto& eventlet : packet.eventlets)
+      clusterer.insert(eventlet);
+    clusterer.advance(packet.time_end);
+    plane.stats.items += packet.eventlets.size();
+    RetiredClusters retired;
+    clusterer.pop(retired);
+    plane.stats.busy += secs_since(busy);
+
+    plane.out.push(std::move(retired));
+  }
+
+  clusterer.dump();
+  RetiredClusters retired;
+  clusterer.pop(retired);
+  plane.out.push(std::move(retired));
+  plane.out.close();
+  plane.stats.wall = secs_since(start);
+}
+
+void ClusterPipeline::correlate()
+{
+  auto start = Clock::now();
+  Correlator correlator(params_.time_slack, params_.strip_slack);
+  std::vector<uint64_t> watermarks(planes_.size(), 0);
+  RetiredClusters retired;
+  Backoff idle;
+  size_t drained {0};
+  while (drained < planes_.size())
+  {
+    //take from any plane, so that one running ahead is never held back
+    bool added {false};
+    drained = 0;
+    auto busy = Clock::now();
+    for (size_t i = 0; i < planes_.size(); ++i)
+    {
+      if (planes_[i]->out.try_pop(retired))
+      {
+        correlator.add(retired);
+        watermarks[i] = retired.watermark;
+        correlate_stats_.items += retired.ends.size();
+        added = true;
+      }
+      else if (planes_[i]->out.drained())
+        drained++;
+    }
+
+    if (!added)
+    {
+      if (drained < planes_.size())
+        idle.wait();
+      continue;
+    }
+    idle.reset();
+
+    correlator.correlate(*std::min_element(watermarks.begin(),
+                                           watermarks.end()));
+    auto events = correlator.pop_events();
+    correlate_stats_.busy += secs_since(busy);
+
+    if (!events.empty())
+      clustered_.push(std::move(events));
+  }
+
+  auto busy = Clock::now();
+  correlator.dump();
+  auto events = correlator.pop_events();
+  correlate_stats_.busy += secs_since(busy);
+
+  if (!events.empty())
+    clustered_.push(std::move(events));
+  clustered_.close();
+  correlate_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::analyze()
+{
+  auto start = Clock::now();
+  std::list<SimpleEvent> events;
+  while (clustered_.pop(events))
+  {
+    auto busy = Clock::now();
+    std::vector<Event> good;
+    analyze_events(events, good);
+    analyze_stats_.items += events.size();
+    analyze_stats_.busy += secs_since(busy);
+
+    if (!good.empty())
+      analyzed_.push(std::move(good));
+  }
+  analyzed_.close();
+  analyze_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::write()
+{
+  auto start = Clock::now();
+  std::vector<Event> events;
+  while (analyzed_.pop(events))
+    write_events(events);
+  write_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::segment(Worker& worker)
+{
+  auto start = Clock::now();
+  Clusterer clusterer(params_.time_slack, params_.strip_slack,
+                      params_.correlation_slack, params_.correlation_bound);
+  Chunk chunk;
+  while (worker.in.pop(chunk))
+  {
+    auto busy = Clock::now();
+    for (const auto& eventlet : chunk.packet.eventlets)
+      clusterer.insert(eventlet);
+    worker.stats.items += chunk.packet.eventlets.size();
+
+    //leaves the clusterer empty for the next segment
+    if (chunk.last)
+    {
+      clusterer.dump();
+      worker.segments++;
+    }
+
+    Batch batch;
+    batch.last = chunk.last;
+    auto events = clusterer.pop_events();
+    analyze_events(events, batch.events);
+    worker.stats.busy += secs_since(busy);
+
+    if (batch.last || !batch.events.empty())
+      worker.out.push(std::move(batch));
+  }
+  worker.out.close();
+  worker.stats.wall = secs_since(start);
+}
+
+void ClusterPipeline::write_segments()
+{
+  auto start = Clock::now();
+  //segments were handed out round robin, so take them back the same way
+  size_t current {0};
+  Batch batch;
+  while (workers_[current]->out.pop(batch))
+  {
+    write_events(batch.events);
+    if (batch.last)
+      current = (current + 1) % workers_.size();
+  }
+  //a failed worker closes early, the others must not be left blocking
+  drain(workers_, &Worker::out);
+  write_stats_.wall = secs_since(start);
+}
+
+void ClusterPipeline::write_events(const std::vector<Event>& events)
+{
+  auto busy = Clock::now();
+  {
+    std::lock_guard<std::mutex> io(io_mutex());
+    for (const auto& event : events)
+    {
+      writer_.write_event(events_, event);
+      events_++;
+    }
+  }
+  write_stats_.items += events.size();
+  write_stats_.busy += secs_since(busy);
+}
+
+std::string ClusterPipeline::report() const
+{
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(3);
+
+  std::vector<const StageStats*> stages {&read_stats_, &order_stats_};
+  if (workers_.empty() && planes_.empty())
+    stages.push_back(&cluster_stats_);
+  for (auto& plane : planes_)
+    stages.push_back(&plane->stats);
+  if (!planes_.empty())
+    stages.push_back(&correlate_stats_);
+  if (workers_.empty())
+    stages.push_back(&analyze_stats_);
+  for (auto& worker : workers_)
+    stages.push_back(&worker->stats);
+  stages.push_back(&write_stats_);
+
+  ss << "Stage      items                busy(s)   wall(s)   items/busy s\n";
+  for (auto s : stages)
+  {
+    ss << std::left << std::setw(11) << s->name
+       << std::setw(10) << s->items << std::setw(11) << s->unit
+       << std::right << std::setw(9) << s->busy
+       << std::setw(10) << s->wall
+       << std::setw(15) << std::setprecision(0)
+       << (s->busy > 0 ? s->items / s->busy : 0.0)
+       << std::setprecision(3) << "\n";
+  }
+
+  ss << "Queue      capacity  pushes    mean depth  max depth  "
+     << "producer waits  consumer waits\n";
+  auto queue = [&ss](const std::string& name, size_t capacity, size_t pushes,
+                     double mean, size_t max, size_t full, size_t empty)
+  {
+    ss << std::left << std::setw(11) << name
+       << std::setw(10) << capacity << std::setw(10) << pushes
+       << std::right << std::setw(10) << std::setprecision(1) << mean
+       << std::setw(11) << max
+       << std::setw(16) << full
+       << std::setw(16) << empty << "\n";
+  };
+  queue("read", read_.capacity(), read_.pushes(), read_.mean_depth(),
+        read_.max_depth(), read_.full_waits(), read_.empty_waits());
+  if (workers_.empty() && planes_.empty())
+    queue("ordered", ordered_.capacity(), ordered_.pushes(),
+          ordered_.mean_depth(), ordered_.max_depth(),
+          ordered_.full_waits(), ordered_.empty_waits());
+  for (size_t i = 0; i < planes_.size(); ++i)
+  {
+    const auto& p = *planes_[i];
+    queue("plane " + std::to_string(i), p.in.capacity(), p.in.pushes(),
+          p.in.mean_depth(), p.in.max_depth(),
+          p.in.full_waits(), p.in.empty_waits());
+    queue("retired " + std::to_string(i), p.out.capacity(), p.out.pushes(),
+          p.out.mean_depth(), p.out.max_depth(),
+          p.out.full_waits(), p.out.empty_waits());
+  }
+  if (workers_.empty())
+  {
+    queue("clustered", clustered_.capacity(), clustered_.pushes(),
+          clustered_.mean_depth(), clustered_.max_depth(),
+          clustered_.full_waits(), clustered_.empty_waits());
+    queue("analyzed", analyzed_.capacity(), analyzed_.pushes(),
+          analyzed_.mean_depth(), analyzed_.max_depth(),
+          analyzed_.full_waits(), analyzed_.empty_waits());
+  }
+  for (size_t i = 0; i < workers_.size(); ++i)
+  {
+    const auto& w = *workers_[i];
+    queue("in " + std::to_string(i), w.in.capacity(), w.in.pushes(),
+          w.in.mean_depth(), w.in.max_depth(),
+          w.in.full_waits(), w.in.empty_waits());
+    queue("out " + std::to_string(i), w.out.capacity(), w.out.pushes(),
+          w.out.mean_depth(), w.out.max_depth(),
+          w.out.full_waits(), w.out.empty_waits());
+  }
+
+  if (!workers_.empty())
+  {
+    size_t segments {0};
+    for (auto& worker : workers_)
+      segments += worker->segments;
+    ss << "Segments clustered: " << segments << "\n";
+  }
+  return ss.str();
+}
+
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "RawClustered.h"
+#include "Event.h"
+#include "SimpleEvent.h"
+#include "SPSCQueue.h"
+#include "PlaneClusterer.h"
+#include "Segmenter.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace NMX {
+
+struct ClusterParams
+{
+  uint16_t time_slack {28};
+  uint16_t strip_slack {18};
+  uint16_t correlation_slack {3};
+  uint64_t latency {84};
+  //most events a clusterer forms per eventlet inserted, 0 for no bound;
+  //keeps the pause after a quiet gap short without changing the events
+  size_t correlation_bound {64};
+
+  size_t packet_size {500};
+  //packets or event batches buffered between two stages
+  size_t queue_depth {64};
+
+  //clusterers working concurrently on segments of the time ordered stream,
+  //0 for a single clustering stage
+  size_t workers {0};
+  //eventlets in a segment before it may be cut at a quiet gap
+  size_t segment_size {20000};
+
+  //clusters each plane on its own thread and correlates on another,
+  //unless there are workers
+  bool split_planes {false};
+};
+
+// Clusters raw/VMM eventlets into events, as a pipeline of stages each on
+// its own thread: reader, time ordering, clustering with correlation,
+// event analysis and writer.
+//
+// With workers, a Segmenter cuts the time ordered stream into segments where
+// eventlets are more than time_slack apart. No cluster spans such a gap, so
+// each segment is clustered and analyzed on its own by one of the workers,
+// round robin, and the writer takes their events back in segment order.
+// Events and their indices are the same as with a single clustering stage.
+//
+// With split planes, the X and Y eventlets are clustered by PlaneClusterers
+// on two threads, and their retired clusters merged by time in a Correlator
+// on a third. Each plane then retires clusters only when it opens one, and
+// events are formed once no overlapping cluster can still arrive, so events
+// may differ slightly from those of the single clustering stage.
+class ClusterPipeline
+{
+public:
+  ClusterPipeline(const RawVMM& reader, RawClustered& writer,
+                  ClusterParams params);
+
+  //runs until all eventlets are written out as events; progress is called
+  //from the reader with the number of eventlets read, false stops reading.
+  //If a stage throws, reading stops, the other stages drain and finish, and
+  //the first exception is rethrown here
+  void run(std::function<bool(size_t)> progress);
+
+  size_t events() const { return events_; }
+
+  //throughput of each stage and depth of each queue in the last run
+  std::string report() const;
+
+private:
+  const RawVMM& reader_;
+  RawClustered& writer_;
+  ClusterParams params_;
+  size_t events_ {0};
+
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+  std::atomic<bool> failed_ {false};
+
+  struct StageStats
+  {
+    StageStats(std::string n, std::string u) : name(n), unit(u) {}
+
+    std::string name;
+    std::string unit;
+    size_t items {0};
+    double busy {0}; //secs spent working, not waiting on queues
+    double wall {0};
+  };
+
+  //eventlets of a segment, last closes it
+  struct Chunk
+  {
+    EventletPacket packet;
+    bool last {false};
+  };
+
+  //good events of a segment, last closes it
+  struct Batch
+  {
+    std::vector<Event> events;
+    bool last {false};
+  };
+
+  struct Worker
+  {
+    Worker(size_t depth, std::string name)
+      : in(depth), out(depth), stats(name, "eventlets") {}
+
+    SPSCQueue<Chunk> in;
+    SPSCQueue<Batch> out;
+    StageStats stats;
+    size_t segments {0};
+  };
+
+  struct PlaneStage
+  {
+    PlaneStage(size_t depth, std::string name)
+      : in(depth), out(depth), stats(name, "eventlets") {}
+
+    SPSCQueue<EventletPacket> in;
+    SPSCQueue<RetiredClusters> out;
+    StageStats stats;
+  };
+
+  SPSCQueue<EventletPacket> read_;
+  SPSCQueue<EventletPacket> ordered_;
+  SPSCQueue<std::list<SimpleEvent>> clustered_;
+  SPSCQueue<std::vector<Event>> analyzed_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::unique_ptr<PlaneStage>> planes_;
+
+  //segment being filled by the ordering stage
+  Segmenter segmenter_;
+  size_t segment_worker_ {0};
+
+  StageStats read_stats_ {"read", "eventlets"};
+  StageStats order_stats_ {"order", "eventlets"};
+  StageStats cluster_stats_ {"cluster", "eventlets"};
+  StageStats correlate_stats_ {"correlate", "clusters"};
+  StageStats analyze_stats_ {"analyze", "events"};
+  StageStats write_stats_ {"write", "events"};
+
+  //runs a stage body; if it throws, keeps the exception and runs recover,
+  //which closes the stage's outputs and drains its inputs
+  void guard(std::function<void()> body, std::function<void()> recover);
+
+  void read(std::function<bool(size_t)> progress);
+  void order();
+  void cluster();
+  void analyze();
+  void write();
+
+  void cluster_plane(PlaneStage& plane);
+  void correlate();
+
+  void segment(Worker& worker);
+  void write_segments();
+
+  void deliver(EventletPacket&& packet, bool last);
+  void send(Chunk&& chunk);
+  void write_events(const std::vector<Event>& events);
+};
+
+}
@@ -8,9 +8,7 @@
 
 #include "RawClustered.h"
 
-#include "Clusterer.h"
-#include "LatencyQ.h"
-#include "ChronoQ.h"
+#include "ClusterPipeline.h"
 
 using namespace NMX;
 using namespace std;
@@ -19,8 +17,9 @@ using namespace boost::filesystem;
 void cluster(const path& file, int chunksize);
 
 void cluster_eventlets(const path& file,
-                       int chunksize, int timesep,
-                       int stripsep, int corsep);
+                       int chunksize, bool compact, int timesep,
+                       int stripsep, int corsep, int threads,
+                       bool planes, int cbound);
 
 volatile sig_atomic_t term_flag = 0;
 void term_key(int /*sig*/)
@@ -32,15 +31,19 @@ static const char USAGE[] =
     R"(nmx analyze
 
     Usage:
-    nmx_analyze PATH [-s settings] [-chunk size] [-tsep tb] [-ssep strips] [-csep tb]
+    nmx_analyze PATH [-s settings] [--chunk <rows>] [--compact] [-tsep tb] [-ssep strips] [-csep tb] [--threads <n>] [--planes] [--cbound <n>]
     nmx_analyze (-h | --help)
 
     Options:
     -h --help    Show this screen.
-    --chunk      raw/VMM chunk size [default: 20]
+    --chunk <rows>  raw/VMM chunk rows, 0 for automatic [default: 0]
+    --compact    write delta-encoded compact raw/VMM layout
     --tsep       minimum time separation between events [default: 28]
     --ssep       minimum strip separation between events  [default: 18]
     --csep       minimum time separation correlation [default: 3]
+    --threads <n>  cluster segments between quiet gaps on n threads, 0 for one [default: 0]
+    --planes     cluster X and Y planes on separate threads
+    --cbound <n>   most events formed per eventlet, 0 for no bound [default: 64]
     )";
 
 int main(int argc, char* argv[])
@@ -57,8 +60,6 @@ int main(int argc, char* argv[])
   int chunksize {0};
   if (args.count("--chunk"))
     chunksize = args["--chunk"].asLong();
-  if (chunksize < 1)
-    chunksize = 20;
 
   int timesep {0};
   if (args.count("--tsep"))
@@ -72,14 +73,26 @@ int main(int argc, char* argv[])
   if (args.count("--csep"))
     corsep = args["--csep"].asLong();
 
-  cout << "Saving as emulated VMM data using chunksize=" << chunksize << "\n";
+  int threads {0};
+  if (args.count("--threads"))
+    threads = args["--threads"].asLong();
 
-  cluster_eventlets(infile, chunksize, timesep, stripsep, corsep);
+  int cbound {64};
+  if (args.count("--cbound"))
+    cbound = args["--cbound"].asLong();
+
+  bool compact = args["--compact"].asBool();
+  bool planes = args["--planes"].asBool();
+
+  cluster_eventlets(infile, chunksize, compact, timesep, stripsep, corsep,
+                    threads, planes, cbound);
 
   return 0;
 }
 
-void cluster_eventlets(const path& file, int chunksize, int timesep, int stripsep, int corsep)
+void cluster_eventlets(const path& file, int chunksize, bool compact,
+                       int timesep, int stripsep, int corsep, int threads,
+                       bool planes, int cbound)
 {
   string filename = file.string();
   string newname = boost::filesystem::change_extension(filename, "").string() +
@@ -107,71 +120,59 @@ void cluster_eventlets(const path& file, int chunksize, int timesep, int stripse
 
   size_t eventlet_count = reader.eventlet_count();
 
-  H5CC::File outfile(newname, H5CC::Access::rw_truncate);
-  RawClustered writer(outfile, H5CC::kMax, chunksize);
-
-  Clusterer clusterer(timesep, stripsep, corsep);
-  uint64_t evcount {0};
-
-  size_t packetsize {500};
+  ChunkPolicy chunking = ChunkPolicy::automatic(eventlet_count);
+  if (chunksize > 0)
+    chunking = ChunkPolicy::fixed_rows(chunksize);
+  cout << "Saving as emulated VMM data using chunking=" << chunking.debug() << "\n";
 
-  EventletPacket packet(packetsize);
-  LatencyQueue lq(timesep*3);
-  ChronoQ cq(timesep*3);
+  H5CC::File outfile(newname, H5CC::Access::rw_truncate);
+  RawClustered writer(outfile, H5CC::kMax, chunking,
+                      compact ? RawVMM::Layout::compact : RawVMM::Layout::plain);
+
+  ClusterParams params;
+  params.time_slack = timesep;
+  params.strip_slack = stripsep;
+  params.correlation_slack = corsep;
+  params.latency = timesep * 3;
+  params.workers = std::max(threads, 0);
+  params.split_planes = planes;
+  params.correlation_bound = std::max(cbound, 0);
 
   std::cout << "Clustering with timesep=" << timesep
             << " stripsep=" << stripsep
-            << " corr_timesep=" << corsep << "\n";
+            << " corr_timesep=" << corsep
+            << " corr_bound=" << params.correlation_bound;
+  if (params.workers)
+    std::cout << " threads=" << params.workers;
+  else if (params.split_planes)
+    std::cout << " planes=split";
+  std::cout << "\n";
 
   auto prog = progbar(eventlet_count, "  Clustering '" + newname + "'  ");
+  size_t shown {0};
   CustomTimer timer(true);
-  for (size_t i = 0; i < /*100*/ eventlet_count; i+=packetsize)
-  {
-    reader.read_packet(i, packet);
-    lq.push(packet);
-
-    while (lq.ready())
-      cq.push(lq.pop());
-
-    while (cq.ready())
-      clusterer.insert(cq.pop());
-
-    while (clusterer.events_ready())
-      for (auto event : clusterer.pop_events())
-      {
-        event.analyze(true, 3, 6);
-        if (event.good())
-          writer.write_event(evcount++, Event(event));
-      }
-
-//    for (int c=0; c < packetsize; ++c)
-//      ++(*prog);
 
-    (*prog)+=packetsize;
-
-    if (term_flag)
-      break;
+  ClusterPipeline pipeline(reader, writer, params);
+  try
+  {
+    pipeline.run([&](size_t read)
+    {
+      (*prog) += (read - shown);
+      shown = read;
+      return !term_flag;
+    });
   }
-
-  if (packet.eventlets.size())
-    lq.push(packet);
-
-  while (!lq.empty())
-    cq.push(lq.pop());
-
-  while (!cq.empty())
-    clusterer.insert(cq.pop());
-
-  clusterer.dump();
-
-  for (auto event : clusterer.pop_events())
+  catch (...)
   {
-    event.analyze(true, 3, 6);
-    if (event.good())
-      writer.write_event(evcount++, Event(event));
+    printException();
+    cout << "Clustering " << filename << " failed after "
+         << pipeline.events() << " events\n";
+    return;
   }
+  uint64_t evcount = pipeline.events();
 
   cout << "\n";
   cout << "Clustered " << eventlet_count << " eventlets into " << evcount << " events\n";
   cout << "Processing time = " << timer.done() << "   secs/1000events=" << timer.s() / eventlet_count * 1000 << "\n";
+  cout << pipeline.report();
 }
@@ -1,5 +1,8 @@
 #include "Filesystem.h"
+#include "OrderedPool.h"
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 namespace fs = boost::filesystem;
 
@@ -75,3 +78,14 @@ std::set<fs::path> find_files(std::string path, bool recurse)
   }
   return ret;
 }
+
+void for_each_file(const std::set<fs::path>& files, size_t jobs,
+                   std::function<void(size_t, const fs::path&)> process,
+                   std::function<bool(size_t, const fs::path&)> finish)
+{
+  std::vector<fs::path> list(files.begin(), files.end());
+
+  for_each_in_order(0, list.size(), jobs, jobs * 2, nullptr,
+                    [&](size_t i) { process(i, list[i]); },
+                    [&](size_t i) { return !finish || finish(i, list[i]); });
+}
@@ -2,6 +2,7 @@
 
 #include <boost/filesystem.hpp>
 #include <set>
+#include <functional>
 
 std::set<boost::filesystem::path> files_in(boost::filesystem::path path,
                                            std::string ext = "",
@@ -13,3 +14,14 @@ boost::filesystem::path relative_to(boost::filesystem::path from,
 
 std::set<boost::filesystem::path> find_files
     (std::string path, bool recurse);
+
+// Runs process(index, file) for all files on up to jobs threads, then
+// finish(index, file) on the calling thread strictly in file order, so
+// that output can go through a single deterministic writer. At most
+// 2*jobs processed files wait to be finished. finish returns false to stop.
+// The first exception thrown by process or finish stops all jobs and is
+// rethrown here once the threads are joined.
+void for_each_file
+    (const std::set<boost::filesystem::path>& files, size_t jobs,
+     std::function<void(size_t, const boost::filesystem::path&)> process,
+     std::function<bool(size_t, const boost::filesystem::path&)> finish = nullptr);
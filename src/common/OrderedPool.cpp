@@ -0,0 +1,121 @@
+#include "OrderedPool.h"
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+void for_each_in_order(size_t begin, size_t end,
+                       size_t threads, size_t window,
+                       std::function<void(size_t)> prepare,
+                       std::function<void(size_t)> process,
+                       std::function<bool(size_t)> finish)
+{
+  if (threads < 2)
+  {
+    for (size_t index = begin; index < end; ++index)
+    {
+      if (prepare)
+        prepare(index);
+      process(index);
+      if (finish && !finish(index))
+        return;
+    }
+    return;
+  }
+
+  window = std::max(window, size_t(1));
+
+  std::mutex mutex;
+  std::condition_variable jobs_cond, done_cond;
+  std::vector<bool> done(window, false);
+  size_t prepared {begin};
+  size_t taken {begin};
+  std::exception_ptr error;
+  bool quit {false};
+
+  //first failure stops everyone, rethrown once workers are joined
+  auto fail = [&]()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!error)
+      error = std::current_exception();
+    quit = true;
+    jobs_cond.notify_all();
+    done_cond.notify_all();
+  };
+
+  auto work = [&]()
+  {
+    try
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true)
+      {
+        jobs_cond.wait(lock, [&]{ return quit || (taken >= end)
+                                         || (taken < prepared); });
+        if (quit || (taken >= end))
+          return;
+        size_t index = taken++;
+        lock.unlock();
+        process(index);
+        lock.lock();
+        done[index % window] = true;
+        done_cond.notify_all();
+      }
+    }
+    catch (...)
+    {
+      fail();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  if (end > begin)
+    for (size_t i = 0; i < std::min(threads, end - begin); ++i)
+      workers.push_back(std::thread(work));
+
+  try
+  {
+    //bounded number of indices in flight
+    size_t next {begin};
+    for (size_t index = begin; index < end; ++index)
+    {
+      while ((next < end) && ((next - index) < window))
+      {
+        if (prepare)
+          prepare(next);
+        std::lock_guard<std::mutex> lock(mutex);
+        prepared = ++next;
+        jobs_cond.notify_one();
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cond.wait(lock, [&]{ return quit || done[index % window]; });
+        if (quit)
+          break;
+        done[index % window] = false;
+      }
+
+      if (finish && !finish(index))
+        break;
+    }
+  }
+  catch (...)
+  {
+    fail();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  jobs_cond.notify_all();
+  for (auto& w : workers)
+    w.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
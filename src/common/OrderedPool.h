@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+#include <cstddef>
+
+// Runs process(index) for all indices in [begin, end) on up to threads
+// worker threads, and finish(index) on the calling thread strictly in index
+// order. prepare(index), if given, also runs on the calling thread in index
+// order, before that index is handed to a worker. At most window indices
+// are prepared but not yet finished, so per-index state can be kept in
+// slots [index % window] without further locking. finish returns false to
+// stop. With fewer than 2 threads everything runs on the calling thread.
+// The first exception thrown by any of them stops all threads and is
+// rethrown here once they are joined.
+void for_each_in_order(size_t begin, size_t end,
+                       size_t threads, size_t window,
+                       std::function<void(size_t)> prepare,
+                       std::function<void(size_t)> process,
+                       std::function<bool(size_t)> finish);
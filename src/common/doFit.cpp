@@ -5,6 +5,7 @@
 #include "CustomLogger.h"
 
 #include <sstream>
+#include <mutex>
 
 EdgeFitter::EdgeFitter(HistMap1D data)
 {
@@ -70,6 +71,10 @@ void EdgeFitter::analyze(std::string edge)
       (edge_ != "left" && edge_ != "right" && edge_ != "double"))
     return;
 
+  //ROOT keeps named objects in global lists, fit one at a time
+  static std::mutex root_mutex;
+  std::lock_guard<std::mutex> lock(root_mutex);
+
   TH1D* h1 = new TH1D("h1", "h1", data_.size(), fits, fite);
   int i=1;
   for (auto h :data_)
@@ -0,0 +1,208 @@
+#include "APVBatch.h"
+#include "StripKernels.h"
+
+#include <algorithm>
+
+namespace NMX {
+
+namespace {
+
+//per plane: strips_vmm_, strips_better_, strips_best_ metrics,
+//then timebins_entry_c and not_gamma
+const size_t plane_columns = 3 * PlanePerspective::metric_count + 2;
+
+//buffers reused across the planes of a batch
+struct Scratch
+{
+  std::vector<int16_t> clamped;
+  std::vector<uint64_t> over;
+  std::vector<int16_t> kept;
+};
+
+//Separated<StripVMM> over every strip of a plane, from one threshold mask
+//of the whole plane; appends the maxima to points
+PlanePerspective vmm_maxima(const int16_t* samples, size_t strips, size_t timebins,
+                            const PlaneParams& params, Scratch& scratch,
+                            std::vector<p2d>& points, uint16_t& timebin_span)
+{
+  const auto& sp = params.strip;
+  size_t n = strips * timebins;
+
+  if ((params.level == AnalysisLevel::all) && params.suppress_negatives)
+  {
+    scratch.clamped.resize(n);
+    for (size_t i = 0; i < n; ++i)
+      scratch.clamped[i] = std::max(samples[i], int16_t(0));
+    samples = scratch.clamped.data();
+  }
+
+  auto& over = scratch.over;
+  auto& kept = scratch.kept;
+  mask_at_least(samples, n, sp.threshold, over);
+  kept.assign(timebins, 0);
+
+  PlanePerspective ret("strip", "timebin");
+  int tb_lo = timebins;
+  int tb_hi = -1;
+  for (size_t s = 0; s < strips; ++s)
+  {
+    //strips end at their last valid sample, as in Plane
+    size_t base = s * timebins;
+    size_t count = timebins;
+    while (count && !samples[base + count - 1])
+      --count;
+    if (!count)
+      continue;
+
+    size_t stop = base + count;
+    int32_t previous {-1};
+    for (size_t start = next_bit(over, stop, base, true); start < stop;
+         start = next_bit(over, stop, start, true))
+    {
+      size_t end = next_bit(over, stop, start, false) - 1;
+      if ((int(end) - int(start) + 1) >= sp.over_threshold)
+      {
+        size_t max_bin = last_argmax(samples, start, end);
+        int16_t val = samples[max_bin];
+        int32_t tb = max_bin - base;
+        if (val)
+        {
+          if ((previous == -1) || ((tb - previous) > sp.min_peak_separation))
+          {
+            kept[tb] = val;
+            points.push_back(p2d(s, tb, val));
+            tb_lo = std::min(tb_lo, tb);
+            tb_hi = std::max(tb_hi, tb);
+          }
+          previous = tb;
+        }
+      }
+      start = end + 1;
+    }
+
+    ret.add_subset(s, kept.data(), count, sp.cuness_min_span);
+    std::fill(kept.begin(), kept.begin() + count, 0);
+  }
+
+  timebin_span = (tb_hi < tb_lo) ? 0 : (tb_hi - tb_lo + 1);
+  return ret;
+}
+
+//as Plane::analyze_finalize
+double not_gamma(const PlaneParams& params, uint16_t width, uint16_t height)
+{
+  int width_gamma = std::max(width - params.gamma_max_width, 0);
+  int height_gamma = std::max(height - params.gamma_max_height, 0);
+  return width_gamma + height_gamma;
+}
+
+}
+
+HistList2D APVBatchResults::vmm_points(size_t event, size_t plane) const
+{
+  size_t i = 2 * event + plane;
+  return HistList2D(maxima.begin() + offsets[i], maxima.begin() + offsets[i + 1]);
+}
+
+APVBatch::APVBatch(size_t first, size_t strips, size_t timebins,
+                   std::vector<int16_t> samples)
+  : first_(first)
+  , strips_(strips)
+  , timebins_(timebins)
+  , samples_(std::move(samples))
+{
+  if (strips_ && timebins_)
+    events_ = samples_.size() / (2 * strips_ * timebins_);
+}
+
+const int16_t* APVBatch::samples(size_t event, size_t plane) const
+{
+  return samples_.data() + (2 * event + plane) * strips_ * timebins_;
+}
+
+Event APVBatch::event(size_t event) const
+{
+  if (event >= events_)
+    return Event();
+  size_t n = strips_ * timebins_;
+  const int16_t* x = samples(event, 0);
+  const int16_t* y = samples(event, 1);
+  return Event(Plane(std::vector<int16_t>(x, x + n), timebins_),
+               Plane(std::vector<int16_t>(y, y + n), timebins_));
+}
+
+std::shared_ptr<const MetricSchema> APVBatch::metric_schema()
+{
+  static std::shared_ptr<const MetricSchema> schema = []
+  {
+    const auto& event = *Event::metric_schema();
+    auto perspective = PlanePerspective::metric_schema("strip", "timebin");
+    auto ret = std::make_shared<MetricSchema>();
+    auto add = [&](const std::string& name)
+    {
+      ret->add(name, event.description(event.id(name)));
+    };
+    for (std::string plane : {"x.", "y."})
+    {
+      for (std::string group : {"strips_vmm_", "strips_better_", "strips_best_"})
+        for (size_t i = 0; i < perspective.size(); ++i)
+          add(plane + group + perspective.name(i));
+      add(plane + "timebins_entry_c");
+      add(plane + "not_gamma");
+    }
+    add("not_gamma");
+    return ret;
+  }();
+  return schema;
+}
+
+APVBatchResults APVBatch::analyze(const EventParams& params,
+                                  bool with_metrics) const
+{
+  APVBatchResults ret;
+  ret.schema = metric_schema();
+  size_t columns = ret.schema->size();
+  if (with_metrics)
+    ret.metrics.assign(events_ * columns, 0.0);
+  ret.offsets.push_back(0);
+
+  const PlaneParams* planes[2] {&params.x, &params.y};
+  const size_t metric_count = PlanePerspective::metric_count;
+
+  Scratch scratch;
+  for (size_t e = 0; e < events_; ++e)
+  {
+    double* row = with_metrics ? ret.metrics.data() + e * columns : nullptr;
+    for (size_t p = 0; p < 2; ++p)
+    {
+      const auto& pp = *planes[p];
+      uint16_t height {0};
+      auto vmm = vmm_maxima(samples(e, p), strips_, timebins_, pp,
+                            scratch, ret.maxima, height);
+      ret.offsets.push_back(ret.maxima.size());
+      if (!with_metrics)
+        continue;
+
+      double* values = row + p * plane_columns;
+      auto better = vmm.pick_best(pp.strip.best_max_bincount,
+                                  pp.strip.best_max_binspan);
+      auto best = vmm.pick_best(1, pp.strip.best_max_binspan);
+      vmm.metric_values(values);
+      better.metric_values(values + metric_count);
+      best.metric_values(values + 2 * metric_count);
+
+      double tb_entry_c = -1;
+      if (!best.empty())
+        tb_entry_c = best.points().front().y;
+      values[3 * metric_count] = tb_entry_c;
+      values[3 * metric_count + 1] = not_gamma(pp, vmm.span(), height);
+    }
+
+    if (with_metrics)
+      row[2 * plane_columns] = int(row[plane_columns - 1] +
+                                   row[2 * plane_columns - 1]);
+  }
+  return ret;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Event.h"
+
+namespace NMX {
+
+// Results of APVBatch::analyze, in the order of the batch
+struct APVBatchResults
+{
+  //columns of metrics, named as the Event metrics they equal
+  std::shared_ptr<const MetricSchema> schema;
+  //one row of schema->size() values per event, empty if not requested
+  std::vector<double> metrics;
+
+  //VMM maxima of event e, plane p are [offsets[2e+p], offsets[2e+p+1])
+  std::vector<p2d> maxima;
+  std::vector<size_t> offsets;
+
+  double metric(size_t event, size_t id) const
+  {
+    return metrics[event * schema->size() + id];
+  }
+  //as Plane::get_points("strip_vmm")
+  HistList2D vmm_points(size_t event, size_t plane) const;
+};
+
+// Consecutive APV events as one dense [events, 2, strips, timebins] array
+class APVBatch
+{
+public:
+  APVBatch() {}
+  APVBatch(size_t first, size_t strips, size_t timebins,
+           std::vector<int16_t> samples);
+
+  size_t first() const { return first_; }
+  size_t size() const { return events_; }
+  size_t strips() const { return strips_; }
+  size_t timebins() const { return timebins_; }
+
+  //strip-major samples of one plane of the event at first() + event
+  const int16_t* samples(size_t event, size_t plane) const;
+  Event event(size_t event) const;
+
+  //VMM maxima, best candidates and their metrics for every event, running
+  //each stage over the whole batch; values equal those of Event::analyze
+  //at the "all metrics", "fewer metrics" and "to VMMx" levels
+  APVBatchResults analyze(const EventParams& params,
+                          bool with_metrics = true) const;
+
+  static std::shared_ptr<const MetricSchema> metric_schema();
+
+private:
+  size_t first_ {0};
+  size_t events_ {0};
+  size_t strips_ {0};
+  size_t timebins_ {0};
+  std::vector<int16_t> samples_;
+};
+
+}
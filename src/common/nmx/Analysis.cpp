@@ -1,8 +1,12 @@
 #include "Analysis.h"
 #include "CustomLogger.h"
+#include <algorithm>
 
 namespace NMX {
 
+constexpr uint32_t Analysis::default_block_size;
+constexpr uint32_t Analysis::cache_rows;
+
 Analysis::Analysis(H5CC::Group group, uint32_t eventnum)
 {
   group_ = group;
@@ -17,6 +21,7 @@ Analysis::Analysis(H5CC::Group group, uint32_t eventnum)
 
   if (group_.has_group("parameters"))
     params_.read_H5(group_, "parameters");
+  compiled_ = EventParams(params_);
 
   for (auto &d : group_.datasets())
   {
@@ -30,6 +35,7 @@ void Analysis::save()
   if (group_.name().empty() || !modified_)
     return;
 
+  flush();
   group_.write_attribute("num_analyzed", num_analyzed_);
   params_.write_H5(group_, "parameters");
   for (auto &d : group_.datasets())
@@ -44,6 +50,7 @@ void Analysis::set_parameters(const Settings& params)
 
   modified_ = true;
   params_ = params;
+  compiled_ = EventParams(params_);
   if (!group_.name().empty())
     params_.write_H5(group_, "parameters");
 }
@@ -62,7 +69,17 @@ Metric Analysis::metric(std::string name, bool with_data) const
   if (group_.name().empty() || !group_.has_dataset(name))
     return ret;
   if (with_data)
+  {
     ret.read_H5_data(group_.open_dataset(name));
+    if (block_count_ && columns_.count(name))
+    {
+      auto& data = ret.data();
+      const auto& column = columns_.at(name);
+      for (uint32_t i = block_start_;
+           (i < block_start_ + block_count_) && (i < data.size()); ++i)
+        data[i] = buffered_value(column, i);
+    }
+  }
   else
     ret.read_H5(group_.open_dataset(name));
   return ret;
@@ -72,9 +89,19 @@ void Analysis::analyze_event(uint32_t index, Event event)
 {
   if (index >= max_num_)
     return;
+  commit(index, analyze(event));
+}
 
-  event.set_parameters(params_);
-  event.analyze();
+Event Analysis::analyze(Event event) const
+{
+  event.analyze(compiled_);
+  return event;
+}
+
+void Analysis::commit(uint32_t index, const Event& event)
+{
+  if (index >= max_num_)
+    return;
 
   if (group_.datasets().empty())
   {
@@ -85,38 +112,137 @@ void Analysis::analyze_event(uint32_t index, Event event)
     }
   }
 
-  for (auto &a : event.metrics().data())
+  if (columns_.empty())
+    for (auto &d : datasets_)
+      columns_[d.first];
+
+  if (block_count_ && (index != block_start_ + block_count_))
+    flush();
+  if (!block_count_)
+    block_start_ = index;
+
+  const auto& values = event.metrics();
+  if (commit_slots_.schema.get() != &values.schema())
+    map_slots(values);
+
+  const auto& slots = commit_slots_.slots;
+  for (size_t i = 0; i < slots.size(); ++i)
   {
-    double d = a.second.value;
-    metrics_[a.first].calc(d);
-    datasets_[a.first].write(d, {index});
+    if (!slots[i].second || !values.has(i))
+      continue;
+    double d = values.value(i);
+    slots[i].first->calc(d);
+    slots[i].second->resize(block_count_, 0.0);
+    slots[i].second->push_back(d);
   }
+  block_count_++;
 
   if (index >= num_analyzed_)
     num_analyzed_ = index + 1;
 
   modified_ = true;
+
+  if (block_count_ >= default_block_size)
+    flush();
+}
+
+void Analysis::map_slots(const MetricSet& metrics)
+{
+  commit_slots_.schema = metrics.shared_schema();
+  auto& slots = commit_slots_.slots;
+  slots.clear();
+  if (!commit_slots_.schema)
+    return;
+  const auto& schema = *commit_slots_.schema;
+  for (size_t i = 0; i < schema.size(); ++i)
+  {
+    auto column = columns_.find(schema.name(i));
+    if (column == columns_.end())
+      slots.push_back({nullptr, nullptr});
+    else
+      slots.push_back({&metrics_[column->first], &column->second});
+  }
+}
+
+void Analysis::flush()
+{
+  if (!block_count_)
+    return;
+
+  for (auto &c : columns_)
+  {
+    c.second.resize(block_count_, 0.0);
+    datasets_.at(c.first).write(c.second, {block_count_}, {block_start_});
+    c.second.clear();
+  }
+  block_count_ = 0;
+  cache_count_ = 0;
+
+  group_.write_attribute("num_analyzed", num_analyzed_);
+}
+
+bool Analysis::buffered(uint32_t index) const
+{
+  return (index >= block_start_) && (index < block_start_ + block_count_);
 }
 
+double Analysis::buffered_value(const std::vector<double>& column,
+                                uint32_t index) const
+{
+  index -= block_start_;
+  if (index < column.size())
+    return column[index];
+  return 0.0;
+}
 
-Event Analysis::gather_metrics(uint32_t index, Event event) const
+void Analysis::load_cache(uint32_t index) const
+{
+  cache_start_ = index - (index % cache_rows);
+  cache_count_ = std::min(cache_rows, max_num_ - cache_start_);
+
+  for (auto &m : metrics_)
+  {
+    auto& rows = row_cache_[m.first];
+    try
+    {
+      rows = datasets_.at(m.first).read<double>({cache_count_}, {cache_start_});
+    }
+    catch (...)
+    {
+      ERR << "<NMX::Analysis> Failed to read metric \'" << m.first << "\' for events "
+          << cache_start_ << "-" << (cache_start_ + cache_count_ - 1);
+      rows.clear();
+    }
+  }
+}
+
+
+Event Analysis::gather_metrics(uint32_t index, Event event, bool reanalyze) const
 {
   event.set_parameters(params_);
-  event.analyze();
+  if (reanalyze)
+    event.analyze();
 
   if (index >= num_analyzed_)
     return event;
 
+  bool in_block = buffered(index);
+  if (!in_block && ((index < cache_start_) || (index >= cache_start_ + cache_count_)))
+    load_cache(index);
+
   for (auto m : metrics_)
   {
     double d {0.0};
-    try
+    if (in_block)
     {
-      d = datasets_.at(m.first).read<double>({index});
+      if (columns_.count(m.first))
+        d = buffered_value(columns_.at(m.first), index);
     }
-    catch (...)
+    else if (row_cache_.count(m.first))
     {
-      ERR << "<NMX::Analysis> Failed to read metric \'" << m.first << "\' for event " << index;
+      const auto& rows = row_cache_.at(m.first);
+      if ((index - cache_start_) < rows.size())
+        d = rows[index - cache_start_];
     }
 
     event.set_metric(m.first, d, m.second.description());
@@ -13,6 +13,11 @@ public:
   Analysis() {}
   Analysis(H5CC::Group group, uint32_t eventnum);
 
+  // metric values are written in column blocks of this many events
+  static constexpr uint32_t default_block_size {4096};
+  // stored metrics are read back in aligned blocks of this many events
+  static constexpr uint32_t cache_rows {256};
+
   std::list<std::string> metrics() const;
   Metric metric(std::string name, bool with_data = true) const;
   void set_parameters(const Settings&);
@@ -22,18 +27,55 @@ public:
   std::string name() const { return group_.name(); }
 
   void analyze_event(uint32_t index, Event event);
-  Event gather_metrics(uint32_t index, Event event) const;
+  Event analyze(Event event) const;
+  void commit(uint32_t index, const Event& event);
+  Event gather_metrics(uint32_t index, Event event, bool reanalyze = true) const;
 
+  void flush();
   void save();
 
 private:
   Settings params_ { Event().parameters() };
+  EventParams compiled_ { params_ };
   uint32_t num_analyzed_ {0};
   uint32_t max_num_ {0};
   std::map<std::string, Metric> metrics_;
   std::map<std::string, H5CC::DataSet> datasets_;
   H5CC::Group group_;
 
+  // contiguous events [block_start_, block_start_ + block_count_) not yet written
+  std::map<std::string, std::vector<double>> columns_;
+  uint32_t block_start_ {0};
+  uint32_t block_count_ {0};
+
+  // stored rows [cache_start_, cache_start_ + cache_count_) of every metric
+  mutable std::map<std::string, std::vector<double>> row_cache_;
+  mutable uint32_t cache_start_ {0};
+  mutable uint32_t cache_count_ {0};
+
+  // metric and column of each id in the schema of the last committed event,
+  // pointing into this object's maps so copies start over
+  struct CommitSlots
+  {
+    CommitSlots() {}
+    CommitSlots(const CommitSlots&) {}
+    CommitSlots& operator=(const CommitSlots&)
+    {
+      schema.reset();
+      slots.clear();
+      return *this;
+    }
+
+    std::shared_ptr<const MetricSchema> schema;
+    std::vector<std::pair<Metric*, std::vector<double>*>> slots;
+  };
+  CommitSlots commit_slots_;
+  void map_slots(const MetricSet& metrics);
+
+  bool buffered(uint32_t index) const;
+  double buffered_value(const std::vector<double>& column, uint32_t index) const;
+  void load_cache(uint32_t index) const;
+
   bool modified_ {false};
 };
 
@@ -0,0 +1,147 @@
+#include "ChunkPolicy.h"
+#include <algorithm>
+#include <stdexcept>
+#include <hdf5.h>
+
+namespace NMX {
+
+namespace {
+
+/** @brief closes an HDF5 identifier when leaving scope */
+struct Handle
+{
+  Handle(hid_t i, herr_t (*c)(hid_t)) : id(i), close(c) {}
+  ~Handle() { if (id >= 0) close(id); }
+  Handle(const Handle&) = delete;
+  Handle& operator=(const Handle&) = delete;
+
+  hid_t id;
+  herr_t (*close)(hid_t);
+};
+
+}
+
+constexpr size_t ChunkPolicy::min_chunk_bytes;
+constexpr size_t ChunkPolicy::max_chunk_bytes;
+
+ChunkPolicy ChunkPolicy::fixed_rows(size_t rows)
+{
+  ChunkPolicy ret;
+  ret.mode = Mode::rows;
+  ret.value = rows;
+  return ret;
+}
+
+ChunkPolicy ChunkPolicy::fixed_bytes(size_t bytes)
+{
+  ChunkPolicy ret;
+  ret.mode = Mode::bytes;
+  ret.value = bytes;
+  return ret;
+}
+
+ChunkPolicy ChunkPolicy::automatic(size_t expected_rows)
+{
+  ChunkPolicy ret;
+  ret.mode = Mode::automatic;
+  ret.value = expected_rows;
+  return ret;
+}
+
+ChunkPolicy ChunkPolicy::filtered(unsigned deflate, bool shuffle) const
+{
+  ChunkPolicy ret = *this;
+  ret.deflate_level = std::min(deflate, 9u);
+  ret.shuffle = shuffle;
+  return ret;
+}
+
+size_t ChunkPolicy::rows(size_t row_bytes) const
+{
+  row_bytes = std::max(row_bytes, size_t(1));
+
+  size_t bytes {max_chunk_bytes};
+  if (mode == Mode::rows)
+    return std::max(value, size_t(1));
+  else if (mode == Mode::bytes)
+    bytes = value;
+  else if (value > 0)
+  {
+    //aim for ~1000 chunks over the whole dataset, within sane bounds
+    bytes = (value / 1000 + 1) * row_bytes;
+    bytes = std::min(std::max(bytes, min_chunk_bytes), max_chunk_bytes);
+    //no point in chunks larger than the whole dataset
+    bytes = std::min(bytes, value * row_bytes);
+  }
+
+  return std::max(bytes / row_bytes, size_t(1));
+}
+
+std::string ChunkPolicy::debug() const
+{
+  std::string ret;
+  if (mode == Mode::rows)
+    ret = std::to_string(value) + " rows";
+  else if (mode == Mode::bytes)
+    ret = std::to_string(value) + " bytes";
+  else if (value > 0)
+    ret = "automatic for " + std::to_string(value) + " rows";
+  else
+    ret = "automatic";
+  if (shuffle)
+    ret += " +shuffle";
+  if (deflate_level)
+    ret += " +deflate" + std::to_string(deflate_level);
+  return ret;
+}
+
+void ChunkPolicy::create_filtered(const H5CC::File& file, const std::string& path,
+                                  size_t value_bytes, std::vector<hsize_t> dims,
+                                  std::vector<hsize_t> chunk) const
+{
+  if ((!shuffle && !deflate_level) || file.has_dataset(path))
+    return;
+
+  auto fail = [&](const std::string& what)
+  {
+    throw std::runtime_error("<NMX::ChunkPolicy> could not " + what
+                             + " for " + path + " (" + debug() + ")");
+  };
+
+  std::vector<hsize_t> maxdims(dims);
+  for (size_t i = 0; i < dims.size(); ++i)
+  {
+    if (dims[i] != H5CC::kMax)
+      continue;
+    dims[i] = 0;
+    maxdims[i] = H5S_UNLIMITED;
+  }
+
+  //h5cc has no way to pass creation properties, so the dataset is made
+  //through a second handle on the same file, sharing its open state
+  Handle f(H5Fopen(file.name().c_str(), H5F_ACC_RDWR, H5P_DEFAULT), H5Fclose);
+  if (f.id < 0)
+    fail("reopen file");
+  Handle plist(H5Pcreate(H5P_DATASET_CREATE), H5Pclose);
+  if (plist.id < 0)
+    fail("create property list");
+  if (H5Pset_chunk(plist.id, int(chunk.size()), chunk.data()) < 0)
+    fail("set chunk dimensions");
+  //shuffle must precede deflate in the filter pipeline to help it
+  if (shuffle && (H5Pset_shuffle(plist.id) < 0))
+    fail("set shuffle filter");
+  if (deflate_level && (H5Pset_deflate(plist.id, deflate_level) < 0))
+    fail("set deflate filter");
+  Handle space(H5Screate_simple(int(dims.size()), dims.data(), maxdims.data()),
+               H5Sclose);
+  if (space.id < 0)
+    fail("create dataspace");
+  auto type = (value_bytes == sizeof(uint64_t)) ? H5T_NATIVE_UINT64
+                                                : H5T_NATIVE_UINT32;
+  Handle dset(H5Dcreate2(f.id, path.c_str(), type, space.id,
+                         H5P_DEFAULT, plist.id, H5P_DEFAULT), H5Dclose);
+  if (dset.id < 0)
+    fail("create dataset");
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "H5CC_File.h"
+
+namespace NMX {
+
+/** @brief chunk layout for extendible raw datasets
+ *  Row counts are chosen from a target chunk size in bytes, or guessed
+ *  from the expected number of rows when in automatic mode.
+ *  Optional shuffle and deflate filters are applied per chunk.
+ */
+struct ChunkPolicy
+{
+  enum class Mode { rows, bytes, automatic };
+
+  static ChunkPolicy fixed_rows(size_t rows);
+  static ChunkPolicy fixed_bytes(size_t bytes);
+  static ChunkPolicy automatic(size_t expected_rows);
+
+  /** @brief same chunking with shuffle and/or deflate (0 for none)
+   */
+  ChunkPolicy filtered(unsigned deflate, bool shuffle) const;
+
+  /** @brief chunk rows for a dataset with rows of given size in bytes
+   */
+  size_t rows(size_t row_bytes) const;
+
+  /** @brief creates dataset at path with the policy's filters, if any are
+   *  set and it does not exist yet; h5cc then opens it like any other.
+   *  dims as for require_dataset, kMax for extendible; throws on failure
+   */
+  void create_filtered(const H5CC::File& file, const std::string& path,
+                       size_t value_bytes, std::vector<hsize_t> dims,
+                       std::vector<hsize_t> chunk) const;
+
+  std::string debug() const;
+
+  Mode mode {Mode::automatic};
+  size_t value {0};
+  unsigned deflate_level {0};
+  bool shuffle {false};
+
+  static constexpr size_t min_chunk_bytes {16 * 1024};
+  static constexpr size_t max_chunk_bytes {1024 * 1024};
+};
+
+}
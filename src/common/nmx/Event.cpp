@@ -4,6 +4,72 @@
 
 namespace NMX {
 
+namespace {
+
+//event metric ids: x., y. and diff_ blocks of plane metrics, then not_gamma
+struct EventIds
+{
+  EventIds()
+    : plane_metrics(Plane::metric_schema()->size())
+    , y_base(plane_metrics)
+    , diff_base(2 * plane_metrics)
+    , not_gamma(3 * plane_metrics)
+    , plane_not_gamma(Plane::metric_schema()->id("not_gamma"))
+  {}
+
+  size_t plane_metrics;
+  size_t y_base;
+  size_t diff_base;
+  size_t not_gamma;
+  size_t plane_not_gamma;
+};
+
+const EventIds& ids()
+{
+  static const EventIds ret;
+  return ret;
+}
+
+void merge_plane(MetricSet& event, const MetricSet& plane,
+                 size_t base, const std::string& prefix)
+{
+  const auto& interned = *Plane::metric_schema();
+  const auto& schema = plane.schema();
+  bool same = (&schema == &interned);
+  for (size_t i = 0; i < schema.size(); ++i)
+  {
+    if (!plane.has(i))
+      continue;
+    if (same || ((i < interned.size()) &&
+                 (schema.description(i) == interned.description(i))))
+      event.set(base + i, plane.value(i));
+    else
+      event.set(prefix + schema.name(i),
+                MetricVal(plane.value(i), schema.description(i)));
+  }
+}
+
+}
+
+std::shared_ptr<const MetricSchema> Event::metric_schema()
+{
+  static std::shared_ptr<const MetricSchema> schema = []
+  {
+    const auto& plane = *Plane::metric_schema();
+    auto ret = std::make_shared<MetricSchema>();
+    for (size_t i = 0; i < plane.size(); ++i)
+      ret->add("x." + plane.name(i), plane.description(i));
+    for (size_t i = 0; i < plane.size(); ++i)
+      ret->add("y." + plane.name(i), plane.description(i));
+    for (size_t i = 0; i < plane.size(); ++i)
+      ret->add("diff_" + plane.name(i),
+               "x." + plane.name(i) + " - y." + plane.name(i));
+    ret->add("not_gamma", "higher numbers indicate event less likely to be a gamma");
+    return ret;
+  }();
+  return schema;
+}
+
 Event::Event()
   :Event(Plane(), Plane())
 {}
@@ -17,6 +83,7 @@ Event::Event(const Plane &xx, const Plane &yy)
   , y_(yy)
 {
   collect_values();
+  parameters_.set("metrics", "", "Metrics to analyze, separated by spaces, all if empty");
 }
 
 bool Event::empty() const
@@ -35,8 +102,13 @@ void Event::collect_values()
   parameters_.merge(x_.parameters(), "x.");
   parameters_.merge(y_.parameters(), "y.");
 
-  metrics_.merge(x_.metrics(), "x.");
-  metrics_.merge(y_.metrics(), "y.");
+  collect_results();
+}
+
+void Event::collect_results()
+{
+  merge_plane(metrics_, x_.metrics(), 0, "x.");
+  merge_plane(metrics_, y_.metrics(), ids().y_base, "y.");
 
   for (auto &a : x_.projection_categories())
     projections_["x." + a] = x_.get_projection(a);
@@ -76,33 +148,110 @@ void Event::clear_metrics()
   y_.clear_metrics();
 }
 
+static std::set<std::string> metric_list(const Settings& settings)
+{
+  std::set<std::string> ret;
+  auto names = settings.get_value("metrics");
+  if (!names.is_string())
+    return ret;
+  std::string list = names.get<std::string>();
+  boost::algorithm::split(ret, list, boost::algorithm::is_any_of(" ,;\t\n"),
+                          boost::algorithm::token_compress_on);
+  ret.erase("");
+  return ret;
+}
+
+EventParams::EventParams(const Settings& settings)
+  : x(settings.with_prefix("x."))
+  , y(settings.with_prefix("y."))
+{
+  request(metric_list(settings));
+}
+
+void EventParams::request(const std::set<std::string>& names)
+{
+  metrics = names;
+  metric_ids.clear();
+  x_metrics.clear();
+  y_metrics.clear();
+  auto schema = Event::metric_schema();
+  for (const auto& m : metrics)
+  {
+    size_t id = schema->id(m);
+    if (id < schema->size())
+      metric_ids.push_back(id);
+
+    if (m.compare(0, 2, "x.") == 0)
+      x_metrics.insert(m.substr(2));
+    else if (m.compare(0, 2, "y.") == 0)
+      y_metrics.insert(m.substr(2));
+    else if (m.compare(0, 5, "diff_") == 0)
+    {
+      x_metrics.insert(m.substr(5));
+      y_metrics.insert(m.substr(5));
+    }
+    else if (m == "not_gamma")
+    {
+      x_metrics.insert(m);
+      y_metrics.insert(m);
+    }
+  }
+}
+
 void Event::analyze()
 {
-  x_.analyze();
-  y_.analyze();
+  EventParams params;
+  params.x = PlaneParams(x_.parameters());
+  params.y = PlaneParams(y_.parameters());
+  params.request(metric_list(parameters_));
+  analyze(params);
+}
 
-  auto ax = x_.metrics();
-  auto ay = y_.metrics();
+void Event::analyze(const EventParams& params)
+{
+  const auto& requested = params.metrics;
 
-  collect_values();
+  if (requested.empty())
+  {
+    x_.analyze(params.x);
+    y_.analyze(params.y);
+  }
+  else
+  {
+    x_.analyze(params.x, &params.x_metrics);
+    y_.analyze(params.y, &params.y_metrics);
+  }
+
+  const auto& ax = x_.metrics();
+  const auto& ay = y_.metrics();
 
-  for (auto x : ax.data())
+  collect_results();
+
+  //ids below plane_metrics are the same in every plane metric set
+  const auto& id = ids();
+  for (size_t i = 0; i < id.plane_metrics; ++i)
+    if (ax.has(i))
+      metrics_.set(id.diff_base + i, ax.value(i) - ay.value(i));
+  const auto& xs = ax.schema();
+  for (size_t i = id.plane_metrics; i < xs.size(); ++i)
   {
-    double val = x.second.value;
-    val -= ay.get_value(x.first);
-    metrics_.set("diff_" + x.first,
-                 MetricVal(val, "x." + x.first +
-                         " - y." + x.first));
+    if (!ax.has(i))
+      continue;
+    const auto& name = xs.name(i);
+    metrics_.set("diff_" + name,
+                 MetricVal(ax.value(i) - ay.get_value(name),
+                           "x." + name + " - y." + name));
   }
 
-  auto not_gamma_x = metrics_.get_value("x.not_gamma");
-  auto not_gamma_y = metrics_.get_value("y.not_gamma");
+  auto not_gamma_x = metrics_.value(id.plane_not_gamma);
+  auto not_gamma_y = metrics_.value(id.y_base + id.plane_not_gamma);
 
   int not_gamma = not_gamma_x + not_gamma_y;
 
-  metrics_.set("not_gamma",
-               MetricVal(not_gamma,
-                       "higher numbers indicate event less likely to be a gamma"));
+  metrics_.set(id.not_gamma, not_gamma);
+
+  if (!requested.empty())
+    metrics_.retain(params.metric_ids);
 
   HistMap1D difs = to_map(x_.get_projection("timebins"));
   for (auto &y : y_.get_projection("timebins"))
@@ -6,6 +6,23 @@
 namespace NMX
 {
 
+//Event parameters compiled for per-event use
+struct EventParams
+{
+  EventParams() {}
+  explicit EventParams(const Settings& settings);
+
+  //whitelist of event metrics, all if empty, with what each plane provides
+  void request(const std::set<std::string>& names);
+
+  PlaneParams x;
+  PlaneParams y;
+  std::set<std::string> metrics;
+  std::vector<size_t> metric_ids;
+  std::set<std::string> x_metrics;
+  std::set<std::string> y_metrics;
+};
+
 struct Event
 {
   Event();
@@ -18,7 +35,10 @@ struct Event
   bool empty() const;
   std::string debug() const;
 
+  // computes only the metrics named by the "metrics" parameter, if set
   void analyze();
+  // as above with compiled parameters, parameters() are left as they are
+  void analyze(const EventParams& params);
   void clear_metrics();
 
   void set_parameters(Settings);
@@ -26,7 +46,10 @@ struct Event
   Settings parameters() const {return parameters_;}
 
   void set_metric(std::string id, double val, std::string descr);
-  MetricSet metrics() const {return metrics_;}
+  const MetricSet& metrics() const {return metrics_;}
+
+  //every metric analyze() can produce
+  static std::shared_ptr<const MetricSchema> metric_schema();
 
   std::list<std::string> projection_categories() const;
   HistList1D get_projection(std::string) const;
@@ -35,11 +58,12 @@ private:
   Plane x_, y_;
 
   Settings parameters_;
-  MetricSet metrics_;
+  MetricSet metrics_ {metric_schema()};
 
   std::map<std::string, HistList1D> projections_;
 
   void collect_values();
+  void collect_results();
 };
 
 }
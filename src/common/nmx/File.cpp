@@ -2,11 +2,15 @@
 #include "CustomLogger.h"
 #include "RawClustered.h"
 #include "RawAPV.h"
+#include "OrderedPool.h"
+#include <algorithm>
+#include <map>
 
 namespace NMX {
 
 File::File(std::string filename, H5CC::Access access)
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   file_ = H5CC::File(filename, access);
   write_access_ = (file_.status() != H5CC::Access::r_existing) &&
       (file_.status() != H5CC::Access::no_access);
@@ -14,8 +18,14 @@ File::File(std::string filename, H5CC::Access access)
 
 File::~File()
 {
+  prefetcher_.reset();
+  //other files may be in use on other threads, release handles under the lock
+  std::lock_guard<std::mutex> io(io_mutex());
   if (!analysis_.name().empty() && write_access_)
     analysis_.save();
+  analysis_ = Analysis();
+  raw_.reset();
+  file_ = H5CC::File();
 }
 
 const std::string File::dataset_name() const
@@ -30,28 +40,46 @@ const std::string File::current_analysis() const
 
 bool File::has_APV()
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   return RawAPV::exists_in(file_);
 }
 
 bool File::has_clustered()
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   return RawClustered::exists_in(file_);
 }
 
 void File::open_raw()
 {
   close_raw();
-  if (has_APV())
-    raw_ = std::make_shared<RawAPV>(file_);
-  else if (has_clustered())
-    raw_ = std::make_shared<RawClustered>(file_);
+  bool apv = has_APV();
+  bool clustered = !apv && has_clustered();
+  {
+    std::lock_guard<std::mutex> io(io_mutex());
+    if (apv)
+      raw_ = std::make_shared<RawAPV>(file_);
+    else if (clustered)
+      raw_ = std::make_shared<RawClustered>(file_);
+  }
+  set_prefetch(prefetch_depth_);
 }
 
 void File::close_raw()
 {
+  prefetcher_.reset();
+  std::lock_guard<std::mutex> io(io_mutex());
   raw_.reset();
 }
 
+void File::set_prefetch(size_t depth)
+{
+  prefetch_depth_ = depth;
+  prefetcher_.reset();
+  if (raw_ && prefetch_depth_)
+    prefetcher_.reset(new Prefetcher(raw_, prefetch_depth_));
+}
+
 size_t File::event_count() const
 {
   if (raw_)
@@ -60,22 +88,44 @@ size_t File::event_count() const
     return 0;
 }
 
-Event File::get_event(size_t index) const
+Event File::get_raw_event(size_t index) const
 {
-  if (raw_)
-    return analysis_.gather_metrics(index, raw_->get_event(index));
-  else
+  if (prefetcher_)
+    return prefetcher_->get_event(index);
+  std::lock_guard<std::mutex> io(io_mutex());
+  return raw_->get_event(index);
+}
+
+Event File::get_event(size_t index, bool reanalyze) const
+{
+  if (!raw_)
     return Event();
+  auto event = get_raw_event(index);
+  std::lock_guard<std::mutex> io(io_mutex());
+  return analysis_.gather_metrics(index, event, reanalyze);
+}
+
+APVBatch File::get_apv_batch(size_t start, size_t count) const
+{
+  auto apv = std::dynamic_pointer_cast<RawAPV>(raw_);
+  if (!apv)
+    return APVBatch();
+  std::lock_guard<std::mutex> io(io_mutex());
+  return apv->read_batch(start, count);
 }
 
 void File::write_event(size_t index, const Event& event)
 {
   if (write_access_ && raw_)
+  {
+    std::lock_guard<std::mutex> io(io_mutex());
     raw_->write_event(index, event);
+  }
 }
 
 std::list<std::string> File::analyses() const
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   if (file_.is_open() && file_.has_group("Analyses"))
     return file_.open_group("Analyses").groups();
   else
@@ -84,6 +134,7 @@ std::list<std::string> File::analyses() const
 
 void File::create_analysis(std::string name)
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   if (write_access_ && !file_.require_group("Analyses").has_group(name))
   {
     file_.open_group("Analyses").create_group(name);
@@ -93,6 +144,7 @@ void File::create_analysis(std::string name)
 
 void File::delete_analysis(std::string name)
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   if (write_access_ && file_.require_group("Analyses").has_group(name))
   {
     file_.require_group("Analyses").remove(name);
@@ -106,6 +158,8 @@ void File::load_analysis(std::string name)
   if (name == analysis_.name())
     return;
 
+  std::lock_guard<std::mutex> io(io_mutex());
+
   if (!analysis_.name().empty() && write_access_)
     analysis_.save();
 
@@ -127,14 +181,117 @@ Settings File::parameters() const
 
 void File::set_parameters(const Settings& params)
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   if (write_access_)
     analysis_.set_parameters(params);
 }
 
 void File::analyze_event(size_t index)
 {
-  if (raw_ && write_access_ && (index <= event_count()))
-    analysis_.analyze_event(index, raw_->get_event(index));
+  if (!raw_ || !write_access_ || (index > event_count()))
+    return;
+
+  //analysis overlaps with prefetching, only storage needs the lock
+  auto event = analysis_.analyze(get_raw_event(index));
+  std::lock_guard<std::mutex> io(io_mutex());
+  analysis_.commit(index, event);
+}
+
+void File::analyze_events(size_t start, size_t stop, size_t threads,
+                          std::function<bool(size_t)> committed)
+{
+  if (!raw_ || !write_access_)
+    return;
+  run_analyses({&analysis_}, {start}, stop, threads, committed);
+}
+
+void File::analyze_events(const std::map<std::string, Settings>& analyses,
+                          size_t threads, std::function<bool(size_t)> committed)
+{
+  if (!raw_ || !write_access_ || analyses.empty())
+    return;
+
+  for (auto &a : analyses)
+    create_analysis(a.first);
+
+  std::vector<Analysis> pending;
+  {
+    std::lock_guard<std::mutex> io(io_mutex());
+    if (!analysis_.name().empty())
+      analysis_.save();
+    for (auto &a : analyses)
+    {
+      pending.push_back(Analysis(file_.open_group("Analyses").open_group(a.first),
+                                 event_count()));
+      pending.back().set_parameters(a.second);
+    }
+  }
+
+  std::vector<Analysis*> targets;
+  std::vector<size_t> resume;
+  for (auto &a : pending)
+  {
+    targets.push_back(&a);
+    resume.push_back(a.num_analyzed());
+  }
+
+  run_analyses(targets, resume, event_count(), threads, committed);
+
+  std::lock_guard<std::mutex> io(io_mutex());
+  for (auto &a : pending)
+    a.save();
+  //current analysis may have been advanced behind its back
+  if (!analysis_.name().empty() && analyses.count(analysis_.name()))
+    analysis_ = Analysis(file_.open_group("Analyses").open_group(analysis_.name()),
+                         event_count());
+}
+
+void File::run_analyses(const std::vector<Analysis*>& analyses,
+                        const std::vector<size_t>& resume, size_t stop,
+                        size_t threads, std::function<bool(size_t)> committed)
+{
+  stop = std::min(stop, event_count());
+  size_t start = *std::min_element(resume.begin(), resume.end());
+
+  //one analyzed copy of the event per analysis, empty where it is not pending
+  typedef std::vector<Event> Results;
+
+  auto analyze = [&](size_t index, const Event& raw)
+  {
+    Results ret(analyses.size());
+    for (size_t i = 0; i < analyses.size(); ++i)
+      if (index >= resume[i])
+        ret[i] = analyses[i]->analyze(raw);
+    return ret;
+  };
+
+  auto commit = [&](size_t index, const Results& events)
+  {
+    std::lock_guard<std::mutex> io(io_mutex());
+    for (size_t i = 0; i < analyses.size(); ++i)
+      if (index >= resume[i])
+        analyses[i]->commit(index, events[i]);
+  };
+
+  //raw events are read in order here, analyzed on workers, committed in order
+  size_t window = std::max(threads, size_t(1)) * 4;
+  std::vector<Event> raw(window);
+  std::vector<Results> analyzed(window);
+
+  for_each_in_order(start, stop, threads, window,
+                    [&](size_t index)
+                    {
+                      raw[index % window] = get_raw_event(index);
+                    },
+                    [&](size_t index)
+                    {
+                      analyzed[index % window] = analyze(index, raw[index % window]);
+                    },
+                    [&](size_t index)
+                    {
+                      commit(index, analyzed[index % window]);
+                      return !committed || committed(index);
+                    });
 }
 
 std::list<std::string> File::metrics() const
@@ -144,6 +301,7 @@ std::list<std::string> File::metrics() const
 
 Metric File::get_metric(std::string cat, bool with_data) const
 {
+  std::lock_guard<std::mutex> io(io_mutex());
   return analysis_.metric(cat, with_data);
 }
 
@@ -2,8 +2,11 @@
 
 #include "H5CC_File.h"
 #include "Raw.h"
+#include "APVBatch.h"
 #include "Analysis.h"
+#include "Prefetcher.h"
 #include <memory>
+#include <functional>
 
 #include "JsonH5.h"
 
@@ -21,8 +24,19 @@ public:
   void open_raw();
   void close_raw();
 
+  /** @brief read raw events ahead on a background thread, 0 to disable
+   */
+  void set_prefetch(size_t depth);
+
   size_t event_count() const;
-  Event get_event(size_t index) const;
+  /** @brief raw event with stored metrics of the current analysis
+   * @param reanalyze also recompute plane analysis from the raw data
+   */
+  Event get_event(size_t index, bool reanalyze = true) const;
+  /** @brief raw events [start, start + count) in one read,
+   *  empty unless the raw data is APV
+   */
+  APVBatch get_apv_batch(size_t start, size_t count) const;
   void write_event(size_t index, const Event& event);
   const std::string dataset_name() const;
   const std::string current_analysis() const;
@@ -38,6 +52,21 @@ public:
   Settings parameters() const;
   void analyze_event(size_t index);
 
+  /** @brief analyzes events [start, stop) on worker threads, committing
+   *  results in index order from the calling thread;
+   *  the first exception from any thread is rethrown after they are joined
+   * @param committed called after each commit, return false to abort
+   */
+  void analyze_events(size_t start, size_t stop, size_t threads,
+                      std::function<bool(size_t)> committed);
+
+  /** @brief reads each raw event once and analyzes it for every given
+   *  analysis, creating them as needed; each resumes from its own num_analyzed
+   * @param committed called after each event is committed to all analyses
+   */
+  void analyze_events(const std::map<std::string, Settings>& analyses,
+                      size_t threads, std::function<bool(size_t)> committed);
+
   std::list<std::string> metrics() const;
   Metric get_metric(std::string cat, bool with_data = true) const;
 
@@ -46,6 +75,14 @@ private:
   std::shared_ptr<Raw> raw_;
   bool write_access_ {false};
 
+  size_t prefetch_depth_ {0};
+  std::unique_ptr<Prefetcher> prefetcher_;
+
+  Event get_raw_event(size_t index) const;
+  void run_analyses(const std::vector<Analysis*>& analyses,
+                    const std::vector<size_t>& resume, size_t stop,
+                    size_t threads, std::function<bool(size_t)> committed);
+
   Analysis       analysis_;
 
 };
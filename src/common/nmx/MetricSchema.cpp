@@ -0,0 +1,30 @@
+#include "MetricSchema.h"
+
+namespace NMX {
+
+size_t MetricSchema::add(const std::string& name, const std::string& description)
+{
+  auto it = ids_.find(name);
+  if (it != ids_.end())
+    return it->second;
+  size_t ret = names_.size();
+  names_.push_back(name);
+  descriptions_.push_back(description);
+  ids_[name] = ret;
+  return ret;
+}
+
+void MetricSchema::describe(size_t id, const std::string& description)
+{
+  descriptions_[id] = description;
+}
+
+size_t MetricSchema::id(const std::string& name) const
+{
+  auto it = ids_.find(name);
+  if (it != ids_.end())
+    return it->second;
+  return names_.size();
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+namespace NMX
+{
+
+// Names and descriptions of metrics, each with a stable integer id.
+// Schemas are registered once per analysis configuration and shared,
+// read-only, by the MetricSets holding per-event values.
+class MetricSchema
+{
+public:
+  // id of name, added with description if not yet present
+  size_t add(const std::string& name, const std::string& description = "");
+  void describe(size_t id, const std::string& description);
+
+  size_t size() const { return names_.size(); }
+  bool contains(const std::string& name) const { return ids_.count(name); }
+  // id of name, size() if absent
+  size_t id(const std::string& name) const;
+
+  const std::string& name(size_t id) const { return names_[id]; }
+  const std::string& description(size_t id) const { return descriptions_[id]; }
+
+private:
+  std::vector<std::string> names_;
+  std::vector<std::string> descriptions_;
+  std::unordered_map<std::string, size_t> ids_;
+};
+
+}
@@ -5,39 +5,120 @@
 
 namespace NMX {
 
+MetricSet::MetricSet(std::shared_ptr<const MetricSchema> schema)
+  : schema_(schema)
+  , values_(schema ? schema->size() : 0, 0.0)
+  , present_(schema ? schema->size() : 0, 0)
+{}
+
+const MetricSchema& MetricSet::schema() const
+{
+  static const MetricSchema empty;
+  if (own_schema_)
+    return *own_schema_;
+  if (schema_)
+    return *schema_;
+  return empty;
+}
+
+std::shared_ptr<const MetricSchema> MetricSet::shared_schema() const
+{
+  if (own_schema_)
+    return own_schema_;
+  return schema_;
+}
+
+size_t MetricSet::own_id(const std::string& name, const std::string& descr,
+                         bool describe)
+{
+  const auto& current = schema();
+  size_t id = current.id(name);
+  if ((id < current.size()) &&
+      (!describe || (current.description(id) == descr)))
+    return id;
+
+  //shared schemas are read-only, extend a private copy
+  if (!own_schema_ || (own_schema_.use_count() > 1))
+  {
+    own_schema_ = std::make_shared<MetricSchema>(current);
+    schema_.reset();
+  }
+  auto& own = *own_schema_;
+  id = own.add(name, descr);
+  if (describe)
+    own.describe(id, descr);
+  values_.resize(own.size(), 0.0);
+  present_.resize(own.size(), 0);
+  return id;
+}
 
 void MetricSet::set(std::string name, MetricVal s)
 {
-  data_[name] = s;
+  set(own_id(name, s.description, true), s.value);
 }
 
 void MetricSet::set(std::string name, double v)
 {
-  data_[name].value = v;
+  set(own_id(name, "", false), v);
+}
+
+void MetricSet::describe(std::string name, std::string descr)
+{
+  own_id(name, descr, true);
+}
+
+std::map<std::string, MetricVal> MetricSet::data() const
+{
+  std::map<std::string, MetricVal> ret;
+  const auto& s = schema();
+  for (size_t i = 0; i < present_.size(); ++i)
+    if (present_[i])
+      ret[s.name(i)] = MetricVal(values_[i], s.description(i));
+  return ret;
+}
+
+size_t MetricSet::size() const
+{
+  size_t ret {0};
+  for (auto p : present_)
+    ret += p;
+  return ret;
 }
 
 MetricVal MetricSet::get(std::string name) const
 {
-  if (data_.count(name))
-    return data_.at(name);
+  size_t id = schema().id(name);
+  if (has(id))
+    return MetricVal(values_[id], schema().description(id));
   else
     return MetricVal();
 }
 
 double MetricSet::get_value(std::string name) const
 {
-  if (data_.count(name))
-    return data_.at(name).value;
-  else
-    return 0;
+  return value(schema().id(name));
+}
+
+void MetricSet::retain(const std::vector<size_t>& ids)
+{
+  std::vector<uint8_t> keep(present_.size(), 0);
+  for (auto id : ids)
+    if (id < keep.size())
+      keep[id] = present_[id];
+  present_.swap(keep);
+}
+
+void MetricSet::clear()
+{
+  present_.assign(present_.size(), 0);
 }
 
 void MetricSet::merge(const MetricSet& other,
                       std::string prepend,
                       std::string append_description)
 {
-  for (auto m : other.data_)
-    data_[prepend + m.first] = MetricVal(m.second.value, m.second.description + append_description);
+  for (auto m : other.data())
+    set(prepend + m.first, MetricVal(m.second.value, m.second.description + append_description));
 }
 
 MetricSet MetricSet::with_prefix(std::string prefix, bool drop_prefix) const
@@ -46,7 +127,7 @@ MetricSet MetricSet::with_prefix(std::string prefix, bool drop_prefix) const
     return *this;
 
   MetricSet ret;
-  for (auto m : data_)
+  for (auto m : data())
   {
     auto id = m.first;
     if ((id.size() > prefix.size()) && (id.substr(0,prefix.size()) == prefix))
@@ -65,7 +146,7 @@ MetricSet MetricSet::with_suffix(std::string suffix, bool drop_suffix) const
     return *this;
 
   MetricSet ret;
-  for (auto m : data_)
+  for (auto m : data())
   {
     auto id = m.first;
     if ((id.size() > suffix.size()) && (id.substr(id.size() - suffix.size(), suffix.size()) == suffix))
@@ -78,4 +159,13 @@ MetricSet MetricSet::with_suffix(std::string suffix, bool drop_suffix) const
   return ret;
 }
 
+MetricSet MetricSet::with_names(const std::set<std::string>& names) const
+{
+  MetricSet ret;
+  for (auto &n : names)
+    if (has(schema().id(n)))
+      ret.set(n, get(n));
+  return ret;
+}
+
 }
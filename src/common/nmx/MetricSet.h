@@ -1,7 +1,10 @@
 #pragma once
 
+#include "MetricSchema.h"
 #include <map>
 #include <string>
+#include <set>
+#include <memory>
 
 namespace NMX
 {
@@ -17,11 +20,17 @@ struct MetricVal
 };
 
 
+// Metric values in a flat array indexed by the ids of a shared schema.
+// Setting a name the schema does not have, or a different description,
+// gives this set its own copy of the schema; ids already in it are kept.
 class MetricSet
 {
 public:
-  std::map<std::string, MetricVal> data() const { return data_; }
-  size_t size() const { return data_.size(); }
+  MetricSet() {}
+  explicit MetricSet(std::shared_ptr<const MetricSchema> schema);
+
+  std::map<std::string, MetricVal> data() const;
+  size_t size() const;
 
   MetricVal get(std::string name) const;
   double get_value(std::string name) const;
@@ -30,17 +39,37 @@ public:
   void set(std::string name, double v);
   void describe(std::string name, std::string descr);
 
-  void clear() { data_.clear(); }
+  //access by schema id
+  const MetricSchema& schema() const;
+  //stays valid and unchanged while held
+  std::shared_ptr<const MetricSchema> shared_schema() const;
+  bool has(size_t id) const { return (id < present_.size()) && present_[id]; }
+  double value(size_t id) const { return has(id) ? values_[id] : 0; }
+  inline void set(size_t id, double v)
+  {
+    values_[id] = v;
+    present_[id] = 1;
+  }
+  //keep only these ids
+  void retain(const std::vector<size_t>& ids);
+
+  void clear();
 
   void merge(const MetricSet& other,
              std::string prepend = "",
              std::string append_description = "");
   MetricSet with_prefix(std::string prefix, bool drop_prefix = true) const;
   MetricSet with_suffix(std::string suffix, bool drop_suffix = true) const;
+  MetricSet with_names(const std::set<std::string>& names) const;
 
 private:
-  std::map<std::string, MetricVal> data_;
+  std::shared_ptr<const MetricSchema> schema_;
+  //replaces schema_ once this set extends it
+  std::shared_ptr<MetricSchema> own_schema_;
+  std::vector<double> values_;
+  std::vector<uint8_t> present_;
+
+  size_t own_id(const std::string& name, const std::string& descr, bool describe);
 };
 
 }
-
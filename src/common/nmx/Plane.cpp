@@ -1,22 +1,109 @@
 #include "Plane.h"
+#include "StripStages.h"
 #include "CustomLogger.h"
 
 #include <iomanip>
 #include <sstream>
 #include <set>
+#include <functional>
 
 namespace NMX {
 
+namespace {
+
+struct MetricGroup
+{
+  std::string perspective;
+  std::string prefix;
+  std::string description;
+  std::string axis1;
+  std::string axis2;
+};
+
+//in order of the groups below
+enum Group : size_t
+{
+  strips_all, strips_max, strips_vmm, strips_better, strips_best,
+  timebins_better, timebins_best, timebins_all, timebins_max, timebins_vmm,
+  tb_strips_max, tb_strips_vmm, group_count
+};
+
+const std::vector<MetricGroup> all_metric_groups
+{
+  {"strips",          "strips_all_",      "valid ADC values", "strip", "timebin"},
+  {"strip_maxima",    "strips_max_",      "local maxima", "strip", "timebin"},
+  {"strip_vmm",       "strips_vmm_",      "VMM maxima", "strip", "timebin"},
+  {"strip_better",    "strips_better_",   "better VMM maxima", "strip", "timebin"},
+  {"strip_best",      "strips_best_",     "best VMM maxima", "strip", "timebin"},
+  {"tb_better",       "timebins_better_", "better VMM maxima", "timebin", "strip"},
+  {"tb_best",         "timebins_best_",   "best VMM maxima", "timebin", "strip"},
+  {"timebins",        "timebins_all_",    "valid ADC values", "timebin", "strip"},
+  {"tb_maxima",       "timebins_max_",    "local maxima", "timebin", "strip"},
+  {"tb_vmm",          "timebins_vmm_",    "VMM maxima", "timebin", "strip"},
+  {"strip_maxima_tb", "tb_strips_max_",   "local maxima in strip space", "timebin", "strip"},
+  {"strip_vmm_tb",    "tb_strips_vmm_",   "VMM maxima in strip space", "timebin", "strip"}
+};
+
+//ids following the group metrics
+const size_t timebins_entry_c_id = group_count * PlanePerspective::metric_count;
+const size_t not_gamma_id = timebins_entry_c_id + 1;
+
+}
+
+std::shared_ptr<const MetricSchema> Plane::metric_schema()
+{
+  static std::shared_ptr<const MetricSchema> schema = []
+  {
+    auto ret = std::make_shared<MetricSchema>();
+    for (const auto& g : all_metric_groups)
+    {
+      auto p = PlanePerspective::metric_schema(g.axis1, g.axis2);
+      for (size_t i = 0; i < p.size(); ++i)
+        ret->add(g.prefix + p.name(i), p.description(i) + g.description);
+    }
+    ret->add("timebins_entry_c", "Latest timebin of VMM maxima");
+    ret->add("not_gamma", "higher numbers indicate event less likely to be a gamma");
+    return ret;
+  }();
+  return schema;
+}
+
+PlaneParams::PlaneParams()
+  : analyzer(Plane::analyzer(level))
+{}
+
+PlaneParams::PlaneParams(const Settings& settings)
+  : strip(settings.with_prefix("strip."))
+  , timebin(settings.with_prefix("timebin."))
+{
+  auto noneg = settings.get_value("suppress_negatives");
+  suppress_negatives = (noneg.is_boolean() && noneg.get<bool>())
+      || (noneg.is_number_float() && noneg.get<double>());
+
+  gamma_max_width = settings.value_or("gamma_max_width", gamma_max_width);
+  gamma_max_height = settings.value_or("gamma_max_height", gamma_max_height);
+
+  nlohmann::json red = settings.get_value("analysis_reduced");
+  if (red.is_number_float())
+    level = static_cast<AnalysisLevel>(int(red.get<double>()));
+  else if (red.count("___choice"))
+    level = static_cast<AnalysisLevel>(red["___choice"].get<int>());
+  analyzer = Plane::analyzer(level);
+}
+
 Plane::Plane()
   : strips_("strip", "timebin")
 {
+  PlaneParams defaults;
   auto strip_par = PlanePerspective::default_params();
   parameters_.merge(strip_par, "strip.");
   parameters_.merge(strip_par, "timebin.");
 
-  parameters_.set("gamma_max_width", 6, "Maximum width for gamma event");
+  parameters_.set("gamma_max_width", defaults.gamma_max_width,
+                  "Maximum width for gamma event");
 
-  parameters_.set("gamma_max_height", 11, "Maximum height for gamma event");
+  parameters_.set("gamma_max_height", defaults.gamma_max_height,
+                  "Maximum height for gamma event");
 
   parameters_.set("analysis_reduced", {{"___choice", 0},
                                        {"___options",
@@ -147,125 +234,190 @@ std::list<std::string> Plane::projection_categories() const
 
 void Plane::analyze()
 {
-  for (auto pl : point_lists_)
-    pl.second.clear();
-  for (auto pj : projections_)
-    pj.second.clear();
+  analyze(PlaneParams(parameters_));
+}
 
-  int reduced = 0;
-  nlohmann::json red = parameters_.get_value("analysis_reduced");
-  if (red.is_number_float())
-    reduced = red.get<double>();
-  else if (red.count("___choice"))
-    reduced = red["___choice"];
-
-  if (reduced == 3)
-    analyze_reduced_from_vmm();
-  else if (reduced == 2)
-    analyze_to_vmm();
-  else if (reduced == 1)
-    analyze_reduced();
-  else
-    analyze_all();
+void Plane::analyze(const std::set<std::string>& metrics)
+{
+  analyze(PlaneParams(parameters_), &metrics);
 }
 
-void Plane::analyze_all()
+void Plane::analyze(const PlaneParams& params,
+                    const std::set<std::string>* metrics)
 {
-  PlanePerspective strips("strip", "timebin");
-  PlanePerspective timebins("timebin", "strip");
+  point_lists_.clear();
+  projections_.clear();
+  (this->*params.analyzer)(params, metrics);
+}
 
-  PlanePerspective strips_noneg = strips_.subset("noneg");
-  if ((parameters_.get_value("suppress_negatives").is_boolean() &&
-       parameters_.get_value("suppress_negatives").get<bool>())
-      ||
-      (parameters_.get_value("suppress_negatives").is_number_float() &&
-            parameters_.get_value("suppress_negatives").get<double>()))
+namespace {
+
+// Perspectives of a plane, each derived from its source on first use
+class PerspectiveGraph
+{
+public:
+  using Derive = std::function<PlanePerspective(const PlanePerspective&)>;
+
+  PerspectiveGraph(const PlanePerspective& plane)
+    : plane_(plane) {}
+
+  // a node without derivation is an alias of its source
+  void add(std::string name, std::string source, Derive derive = nullptr)
   {
-    strips = strips_noneg;
-    timebins = strips_noneg.subset("orthogonal");
+    nodes_[name] = Node{source, derive};
   }
-  else
+
+  bool computed(const std::string& name) const
   {
-    strips = strips_;
-    timebins = strips_.subset("orthogonal");
+    if (!nodes_.count(name))
+      return true;
+    const auto& node = nodes_.at(name);
+    if (!node.derive)
+      return computed(node.source);
+    return cache_.count(name);
   }
 
-  auto strip_params = parameters_.with_prefix("strip.");
-  auto tb_params = parameters_.with_prefix("timebin.");
-
-  auto best_params = strip_params;
-  best_params.set("best_max_bincount", 1);
-
-  PlanePerspective strips_maxima = strips.subset("maxima", strip_params);
-  PlanePerspective strips_vmm = strips.subset("vmm", strip_params);
-  if (strip_params.contains("min_peak_separation") &&
-      (strip_params.get_value("min_peak_separation").get<int>() > 0))
-    strips_vmm = strips_vmm.subset("peak_separation", strip_params);
-  PlanePerspective strips_better = strips_vmm.subset("best", strip_params);
-  PlanePerspective strips_best = strips_vmm.subset("best", best_params);
-  PlanePerspective tb_better = strips_better.subset("orthogonal");
-  PlanePerspective tb_best = strips_best.subset("orthogonal");
-  PlanePerspective tb_maxima = timebins.subset("maxima", tb_params);
-  PlanePerspective tb_vmm = timebins.subset("vmm", tb_params);
-  PlanePerspective strips_maxima_tb = strips_maxima.subset("orthogonal");
-  PlanePerspective strips_vmm_tb = strips_vmm.subset("orthogonal");
-
-  metrics_.merge(strips.metrics(), "strips_all_", "valid ADC values");
-  metrics_.merge(strips_maxima.metrics(), "strips_max_", "local maxima");
-  metrics_.merge(strips_vmm.metrics(), "strips_vmm_", "VMM maxima");
-  metrics_.merge(strips_better.metrics(), "strips_better_", "better VMM maxima");
-  metrics_.merge(strips_best.metrics(), "strips_best_", "best VMM maxima");
-  metrics_.merge(tb_better.metrics(), "timebins_better_", "better VMM maxima");
-  metrics_.merge(tb_best.metrics(), "timebins_best_", "best VMM maxima");
-  metrics_.merge(timebins.metrics(), "timebins_all_", "valid ADC values");
-  metrics_.merge(tb_maxima.metrics(), "timebins_max_", "local maxima");
-  metrics_.merge(tb_vmm.metrics(), "timebins_vmm_", "VMM maxima");
-  metrics_.merge(strips_maxima_tb.metrics(), "tb_strips_max_", "local maxima in strip space");
-  metrics_.merge(strips_vmm_tb.metrics(), "tb_strips_vmm_", "VMM maxima in strip space");
-
-  point_lists_["noneg"] = strips_noneg.points();
-  point_lists_["strip_maxima"] = strips_maxima.points();
-  point_lists_["strip_vmm"] = strips_vmm.points();
-  point_lists_["strip_better"] = strips_better.points();
-  point_lists_["strip_best"] = strips_best.points();
-  point_lists_["tb_maxima"] = tb_maxima.points(true);
-  point_lists_["tb_vmm"] = tb_vmm.points(true);
-  point_lists_["strip_maxima_tb"] = strips_maxima_tb.points(true);
-  point_lists_["strip_vmm_tb"] = strips_vmm_tb.points(true);
+  const PlanePerspective& get(const std::string& name)
+  {
+    if (!nodes_.count(name))
+      return plane_;
+    auto c = cache_.find(name);
+    if (c != cache_.end())
+      return c->second;
+    const auto& node = nodes_.at(name);
+    const auto& source = get(node.source);
+    if (!node.derive)
+      return source;
+    return cache_.insert({name, node.derive(source)}).first->second;
+  }
 
-  projections_["strips"] = strips_.projection();
-  projections_["timebins"] = timebins.projection();
+private:
+  struct Node
+  {
+    std::string source;
+    Derive derive;
+  };
+
+  const PlanePerspective& plane_;
+  std::map<std::string, Node> nodes_;
+  std::map<std::string, PlanePerspective> cache_;
+};
+
+// point lists by perspective, true where drawn with axes flipped
+const std::map<std::string, bool> all_point_lists
+{
+  {"noneg", false},
+  {"strip_maxima", false},
+  {"strip_vmm", false},
+  {"strip_better", false},
+  {"strip_best", false},
+  {"tb_maxima", true},
+  {"tb_vmm", true},
+  {"strip_maxima_tb", true},
+  {"strip_vmm_tb", true}
+};
+
+bool wants(const std::set<std::string>* metrics, const std::string& prefix)
+{
+  if (!metrics)
+    return true;
+  auto m = metrics->lower_bound(prefix);
+  return (m != metrics->end()) && (m->compare(0, prefix.size(), prefix) == 0);
+}
 
-  analyze_finalize(strips_best, strips_vmm);
 }
 
-void Plane::analyze_reduced()
+template<>
+void Plane::analyze_level<AnalysisLevel::all>(const PlaneParams& params,
+                                              const std::set<std::string>* metrics)
 {
-  auto strips = strips_;//.subset("noneg");
-  auto timebins = strips.subset("orthogonal");
+  const auto& strip_params = params.strip;
+  const auto& tb_params = params.timebin;
 
-  auto strip_params = parameters_.with_prefix("strip.");
-  auto tb_params = parameters_.with_prefix("timebin.");
+  auto orthogonal = [](const PlanePerspective& p)
+  {
+    return p.orthogonal();
+  };
 
-  auto best_params = strip_params;
-  best_params.set("best_max_bincount", 1);
+  PerspectiveGraph graph(strips_);
+  graph.add("noneg", "", [](const PlanePerspective& p)
+  {
+    return p.suppress_negatives();
+  });
+  graph.add("strips", params.suppress_negatives ? "noneg" : "");
+  graph.add("timebins", "strips", orthogonal);
+  graph.add("strip_maxima", "strips", [&](const PlanePerspective& p)
+  {
+    return p.transform<StripMaxima>(strip_params);
+  });
+  graph.add("strip_vmm", "strips", [&](const PlanePerspective& p)
+  {
+    return p.transform<Separated<StripVMM>>(strip_params);
+  });
+  graph.add("strip_better", "strip_vmm", [&](const PlanePerspective& p)
+  {
+    return p.pick_best(strip_params.best_max_bincount,
+                       strip_params.best_max_binspan);
+  });
+  graph.add("strip_best", "strip_vmm", [&](const PlanePerspective& p)
+  {
+    return p.pick_best(1, strip_params.best_max_binspan);
+  });
+  graph.add("tb_better", "strip_better", orthogonal);
+  graph.add("tb_best", "strip_best", orthogonal);
+  graph.add("tb_maxima", "timebins", [&](const PlanePerspective& p)
+  {
+    return p.transform<StripMaxima>(tb_params);
+  });
+  graph.add("tb_vmm", "timebins", [&](const PlanePerspective& p)
+  {
+    return p.transform<StripVMM>(tb_params);
+  });
+  graph.add("strip_maxima_tb", "strip_maxima", orthogonal);
+  graph.add("strip_vmm_tb", "strip_vmm", orthogonal);
+
+  for (size_t g = 0; g < group_count; ++g)
+    if (wants(metrics, all_metric_groups[g].prefix))
+      set_metrics(g, graph.get(all_metric_groups[g].perspective));
 
-  PlanePerspective strips_vmm = strips.subset("vmm", strip_params);
-  if (strip_params.contains("min_peak_separation") &&
-      (strip_params.get_value("min_peak_separation").get<int>() > 0))
-    strips_vmm = strips_vmm.subset("peak_separation", strip_params);
-  PlanePerspective strips_better = strips_vmm.subset("best", strip_params);
-  PlanePerspective strips_best = strips_vmm.subset("best", best_params);
-  PlanePerspective tb_vmm = timebins.subset("vmm", tb_params);
+  if (wants(metrics, "timebins_entry_c") || wants(metrics, "not_gamma"))
+    analyze_finalize(params, graph.get("strip_best"),
+                     graph.get("strip_vmm").span(),
+                     graph.get("strip_vmm_tb").span());
 
-  metrics_.merge(strips.metrics(), "strips_all_", "valid ADC values");
-  metrics_.merge(strips_vmm.metrics(), "strips_vmm_", "VMM maxima");
-  metrics_.merge(strips_better.metrics(), "strips_better_", "better VMM maxima");
-  metrics_.merge(strips_best.metrics(), "strips_best_", "best VMM maxima");
-  metrics_.merge(timebins.metrics(), "timebins_all_", "valid ADC values");
-  metrics_.merge(tb_vmm.metrics(), "timebins_vmm_", "VMM maxima");
+  for (const auto& p : all_point_lists)
+    if (!metrics || graph.computed(p.first))
+      point_lists_[p.first] = graph.get(p.first).points(p.second);
 
-  point_lists_["noneg"] = strips.subset("noneg").points();
+  projections_["strips"] = strips_.projection();
+  if (!metrics || graph.computed("timebins"))
+    projections_["timebins"] = graph.get("timebins").projection();
+}
+
+template<>
+void Plane::analyze_level<AnalysisLevel::reduced>(const PlaneParams& params,
+                                                  const std::set<std::string>*)
+{
+  const auto& strips = strips_;
+  auto timebins = strips.orthogonal();
+
+  const auto& strip_params = params.strip;
+  const auto& tb_params = params.timebin;
+
+  auto strips_vmm = strips.transform<Separated<StripVMM>>(strip_params);
+  auto strips_better = strips_vmm.pick_best(strip_params.best_max_bincount,
+                                            strip_params.best_max_binspan);
+  auto strips_best = strips_vmm.pick_best(1, strip_params.best_max_binspan);
+  auto tb_vmm = timebins.transform<StripVMM>(tb_params);
+
+  set_metrics(Group::strips_all, strips);
+  set_metrics(Group::strips_vmm, strips_vmm);
+  set_metrics(Group::strips_better, strips_better);
+  set_metrics(Group::strips_best, strips_best);
+  set_metrics(Group::timebins_all, timebins);
+  set_metrics(Group::timebins_vmm, tb_vmm);
+
+  point_lists_["noneg"] = strips.suppress_negatives().points();
   point_lists_["strip_vmm"] = strips_vmm.points();
   point_lists_["strip_better"] = strips_better.points();
   point_lists_["strip_best"] = strips_best.points();
@@ -273,41 +425,39 @@ void Plane::analyze_reduced()
 
   projections_["timebins"] = timebins.projection();
 
-  analyze_finalize(strips_best, strips_vmm);
+  analyze_finalize(params, strips_best, strips_vmm.span(),
+                   strips_vmm.orthogonal().span());
 }
 
-void Plane::analyze_to_vmm()
+template<>
+void Plane::analyze_level<AnalysisLevel::to_vmm>(const PlaneParams& params,
+                                                 const std::set<std::string>*)
 {
-  auto strips = strips_;
-  auto strip_params = parameters_.with_prefix("strip.");
-  PlanePerspective strips_vmm = strips.subset("vmm", strip_params);
-  if (strip_params.contains("min_peak_separation") &&
-      (strip_params.get_value("min_peak_separation").get<int>() > 0))
-    strips_vmm = strips_vmm.subset("peak_separation", strip_params);
+  auto strips_vmm = strips_.transform<Separated<StripVMM>>(params.strip);
   point_lists_["strip_vmm"] = strips_vmm.points();
 }
 
-void Plane::analyze_reduced_from_vmm()
+template<>
+void Plane::analyze_level<AnalysisLevel::reduced_from_vmm>(const PlaneParams& params,
+                                                           const std::set<std::string>*)
 {
-  auto strip_params = parameters_.with_prefix("strip.");
-  auto best_params = strip_params;
-  best_params.set("best_max_bincount", 1);
+  const auto& strip_params = params.strip;
 
   auto strips = strips_;
-  if (strip_params.contains("min_peak_separation") &&
-      (strip_params.get_value("min_peak_separation").get<int>() > 0))
-    strips = strips.subset("peak_separation", strip_params);
+  if (strip_params.min_peak_separation > 0)
+    strips = strips.transform<StripPeakSeparation>(strip_params);
 
-  auto timebins = strips.subset("orthogonal");
+  auto timebins = strips.orthogonal();
 
-  PlanePerspective strips_better = strips.subset("best", strip_params);
-  PlanePerspective strips_best = strips.subset("best", best_params);
+  auto strips_better = strips.pick_best(strip_params.best_max_bincount,
+                                        strip_params.best_max_binspan);
+  auto strips_best = strips.pick_best(1, strip_params.best_max_binspan);
 
-  metrics_.merge(strips.metrics(), "strips_vmm_", "VMM maxima");
-  metrics_.merge(strips_better.metrics(), "strips_better_", "better VMM maxima");
-  metrics_.merge(strips_best.metrics(), "strips_best_", "best VMM maxima");
+  set_metrics(Group::strips_vmm, strips);
+  set_metrics(Group::strips_better, strips_better);
+  set_metrics(Group::strips_best, strips_best);
 
-  metrics_.merge(timebins.metrics(), "timebins_all_", "valid ADC values");
+  set_metrics(Group::timebins_all, timebins);
 
   point_lists_["strip_vmm"] = strips.points();
   point_lists_["strip_better"] = strips_better.points();
@@ -315,21 +465,42 @@ void Plane::analyze_reduced_from_vmm()
 
   projections_["timebins"] = timebins.projection();
 
-  analyze_finalize(strips_best, strips_);
+  analyze_finalize(params, strips_best, strips.span(),
+                   strips_.orthogonal().span());
+}
+
+PlaneAnalyzer Plane::analyzer(AnalysisLevel level)
+{
+  if (level == AnalysisLevel::reduced_from_vmm)
+    return &Plane::analyze_level<AnalysisLevel::reduced_from_vmm>;
+  else if (level == AnalysisLevel::to_vmm)
+    return &Plane::analyze_level<AnalysisLevel::to_vmm>;
+  else if (level == AnalysisLevel::reduced)
+    return &Plane::analyze_level<AnalysisLevel::reduced>;
+  else
+    return &Plane::analyze_level<AnalysisLevel::all>;
+}
+
+void Plane::set_metrics(size_t group, const PlanePerspective& perspective)
+{
+  double values[PlanePerspective::metric_count];
+  perspective.metric_values(values);
+  size_t base = group * PlanePerspective::metric_count;
+  for (size_t i = 0; i < PlanePerspective::metric_count; ++i)
+    metrics_.set(base + i, values[i]);
 }
 
-void Plane::analyze_finalize(const PlanePerspective& strips_best,
-                              const PlanePerspective& strips_vmm)
+void Plane::analyze_finalize(const PlaneParams& params,
+                             const PlanePerspective& strips_best,
+                             uint16_t width, uint16_t height)
 {
   double tb_entry_c = -1;
   if (!strips_best.empty())
-    tb_entry_c = point_lists_["strip_best"].front().y;
-  metrics_.set("timebins_entry_c", MetricVal(tb_entry_c, "Latest timebin of VMM maxima"));
+    tb_entry_c = strips_best.points().front().y;
+  metrics_.set(timebins_entry_c_id, tb_entry_c);
 
-  auto width  = metrics_.get_value("strips_vmm_span");
-  auto height =  strips_vmm.subset("orthogonal").metrics().get_value("span");
-  int max_width = parameters_.get_value("gamma_max_width");
-  int max_height = parameters_.get_value("gamma_max_height");
+  int max_width = params.gamma_max_width;
+  int max_height = params.gamma_max_height;
 
   int width_gamma = width - max_width;
   if (width_gamma < 0)
@@ -339,9 +510,7 @@ void Plane::analyze_finalize(const PlanePerspective& strips_best,
     height_gamma = 0;
   int not_gamma = width_gamma + height_gamma;
 
-  metrics_.set("not_gamma",
-               MetricVal(not_gamma,
-               "higher numbers indicate event less likely to be a gamma"));
+  metrics_.set(not_gamma_id, not_gamma);
 }
 
 
@@ -3,12 +3,44 @@
 #include "Eventlet.h"
 #include "PlanePerspective.h"
 #include <map>
+#include <set>
 
 namespace NMX
 {
 
 using Histo2D = std::map<std::pair<int32_t,int32_t>, double>;
 
+enum class AnalysisLevel
+{
+  all = 0,
+  reduced = 1,
+  to_vmm = 2,
+  reduced_from_vmm = 3
+};
+
+class Plane;
+struct PlaneParams;
+
+//one of the Plane::analyze_level instantiations
+using PlaneAnalyzer = void (Plane::*)(const PlaneParams&,
+                                      const std::set<std::string>*);
+
+//Plane parameters compiled for per-event use
+struct PlaneParams
+{
+  PlaneParams();
+  explicit PlaneParams(const Settings& settings);
+
+  PerspectiveParams strip;
+  PerspectiveParams timebin;
+  bool suppress_negatives {false};
+  int gamma_max_width {6};
+  int gamma_max_height {11};
+  AnalysisLevel level {AnalysisLevel::all};
+  //pipeline of level, chosen when the parameters are compiled
+  PlaneAnalyzer analyzer;
+};
+
 class Plane
 {
 public:
@@ -31,13 +63,24 @@ public:
   uint16_t time_span() const;
 
   void analyze();
+  // computes only the perspectives needed for the named metrics
+  // (at least those), all analysis levels but "all metrics" ignore this
+  void analyze(const std::set<std::string>& metrics);
+  // as above with compiled parameters, all metrics if none named;
+  // parameters() are left as they are
+  void analyze(const PlaneParams& params,
+               const std::set<std::string>* metrics = nullptr);
   void clear_metrics();
 
   void set_parameter(std::string, nlohmann::json);
   Settings parameters() const {return parameters_;}
 
   void set_metric(std::string id, double val, std::string descr);
-  MetricSet metrics() const {return metrics_;}
+  const MetricSet& metrics() const {return metrics_;}
+
+  //every metric analyze() can produce
+  static std::shared_ptr<const MetricSchema> metric_schema();
+  static PlaneAnalyzer analyzer(AnalysisLevel level);
 
   std::list<std::string> point_categories() const;
   HistList2D get_points(std::string = "") const;
@@ -54,16 +97,18 @@ protected:
   std::map<std::string, HistList1D> projections_;
 
   Settings parameters_;
-  MetricSet metrics_;
+  MetricSet metrics_ {metric_schema()};
 
 
-  void analyze_to_vmm();
-  void analyze_reduced();
-  void analyze_reduced_from_vmm();
-  void analyze_all();
+  //one pipeline of statically typed stages per analysis level
+  template<AnalysisLevel Level>
+  void analyze_level(const PlaneParams& params,
+                     const std::set<std::string>* metrics);
 
-  void analyze_finalize(const PlanePerspective&strips_best,
-                        const PlanePerspective& strips_vmm);
+  void set_metrics(size_t group, const PlanePerspective& perspective);
+  void analyze_finalize(const PlaneParams& params,
+                        const PlanePerspective& strips_best,
+                        uint16_t width, uint16_t height);
 
 };
 
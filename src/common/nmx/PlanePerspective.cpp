@@ -1,30 +1,131 @@
 #include "PlanePerspective.h"
+#include "StripStages.h"
 
 #include <iomanip>
 #include <sstream>
 #include <set>
 #include "CustomLogger.h"
 #include <random>
+#include <algorithm>
 
 namespace NMX {
 
+PerspectiveParams::PerspectiveParams(const Settings& settings)
+  : StripParams(settings)
+{
+  cuness_min_span = settings.value_or("cuness_min_span", cuness_min_span);
+  best_max_bincount = settings.value_or("best_max_bincount", best_max_bincount);
+  best_max_binspan = settings.value_or("best_max_binspan", best_max_binspan);
+}
+
 Settings PlanePerspective::default_params()
 {
+  PerspectiveParams defaults;
   Settings ret;
   ret.merge(Strip::default_params());
   ret.set("suppress_negatives", true, "Suppress negative ADC values prior to analysis");
-  ret.set("cuness_min_span", 2, "Minimum span of maxima to increment cuness_");
-  ret.set("best_max_bincount", 3, "Maximum number of bins for best candidate selection");
-  ret.set("best_max_binspan", 5, "Maximum bin span for best candidate selection");
+  ret.set("cuness_min_span", defaults.cuness_min_span, "Minimum span of maxima to increment cuness_");
+  ret.set("best_max_bincount", defaults.best_max_bincount, "Maximum number of bins for best candidate selection");
+  ret.set("best_max_binspan", defaults.best_max_binspan, "Maximum bin span for best candidate selection");
   return ret;
 }
 
 void PlanePerspective::add_data(int16_t idx, const Strip &strip)
 {
-  if ((idx < 0) || strip.empty())
+  const auto& samples = strip.dense();
+  add_row(idx, samples.data(), 0, samples.size());
+}
+
+void PlanePerspective::fit(int16_t row_lo, int16_t row_hi,
+                           uint16_t col_lo, uint16_t col_hi)
+{
+  if (!buffer_.empty())
+  {
+    row_lo = std::min(row_lo, row_base_);
+    row_hi = std::max(row_hi, int16_t(row_base_ + rows_ - 1));
+    col_lo = std::min(col_lo, col_base_);
+    col_hi = std::max(col_hi, uint16_t(col_base_ + cols_ - 1));
+  }
+
+  uint16_t rows = row_hi - row_lo + 1;
+  uint16_t cols = col_hi - col_lo + 1;
+
+  if ((row_lo == row_base_) && (col_lo == col_base_) && (cols == cols_))
+  {
+    //same columns, only appending strips
+    if (rows > rows_)
+    {
+      buffer_.resize(size_t(rows) * cols, 0);
+      row_integrals_.resize(rows, 0);
+      row_counts_.resize(rows, 0);
+      rows_ = rows;
+    }
     return;
+  }
 
-  data_[idx] = strip;
+  std::vector<int16_t> buffer(size_t(rows) * cols, 0);
+  std::vector<int64_t> integrals(rows, 0);
+  std::vector<uint16_t> counts(rows, 0);
+  for (size_t r = 0; r < rows_; ++r)
+  {
+    size_t to = r + row_base_ - row_lo;
+    std::copy(buffer_.begin() + r * cols_, buffer_.begin() + (r + 1) * cols_,
+              buffer.begin() + to * cols + (col_base_ - col_lo));
+    integrals[to] = row_integrals_[r];
+    counts[to] = row_counts_[r];
+  }
+
+  buffer_.swap(buffer);
+  row_integrals_.swap(integrals);
+  row_counts_.swap(counts);
+  row_base_ = row_lo;
+  rows_ = rows;
+  col_base_ = col_lo;
+  cols_ = cols;
+}
+
+void PlanePerspective::add_row(int16_t idx, const int16_t* samples,
+                               uint16_t first, size_t count)
+{
+  if (idx < 0)
+    return;
+
+  size_t lo {0};
+  while ((lo < count) && !samples[lo])
+    ++lo;
+  if (lo == count)
+    return;
+  size_t hi = count - 1;
+  while (!samples[hi])
+    --hi;
+
+  fit(idx, idx, first + lo, first + hi);
+
+  size_t row = idx - row_base_;
+  auto target = buffer_.begin() + row * cols_;
+  if (row_counts_[row])
+    std::fill(target, target + cols_, 0);
+  else
+    num_strips_++;
+  target += first + lo - col_base_;
+
+  int64_t strip_integral {0};
+  int16_t valid {0};
+  for (size_t i = lo; i <= hi; ++i, ++target)
+  {
+    *target = samples[i];
+    if (!samples[i])
+      continue;
+    strip_integral += samples[i];
+    valid++;
+    uint16_t sample = first + i;
+    auto ortho = sample*sample;
+    sum_idx_ortho_ += idx * ortho;
+    sum_ortho_ += ortho ;
+  }
+  row_integrals_[row] = strip_integral;
+  row_counts_[row] = valid;
+  num_points_ += valid;
 
   if (start_ < 0)
     start_ = idx;
@@ -32,7 +133,6 @@ void PlanePerspective::add_data(int16_t idx, const Strip &strip)
     start_ = std::min(start_, idx);
   end_ = std::max(end_, idx);
 
-  auto strip_integral = strip.integral();
   if (strip_integral > max_adc_)
     max_adc_idx_ = idx;
   if (strip_integral < min_adc_)
@@ -41,17 +141,24 @@ void PlanePerspective::add_data(int16_t idx, const Strip &strip)
   min_adc_ = std::min(min_adc_, strip_integral);
 
   integral_ += strip_integral;
-  sum_idx_  += idx * strip.num_valid();
+  sum_idx_  += idx * valid;
   sum_idx_val_ += idx * strip_integral;
-  for (auto &d : strip.as_tree())
-  {
-    point_list_.push_back(p2d{static_cast<uint32_t>(idx),
-                             static_cast<uint32_t>(d.first),
-                             static_cast<double>(d.second)});
-    auto ortho = d.first*d.first;
-    sum_idx_ortho_ += idx * ortho;
-    sum_ortho_ += ortho ;
-  }
+}
+
+Strip PlanePerspective::strip(size_t row) const
+{
+  std::vector<int16_t> samples(col_base_ + cols_, 0);
+  std::copy(buffer_.begin() + row * cols_, buffer_.begin() + (row + 1) * cols_,
+            samples.begin() + col_base_);
+  return Strip(samples);
+}
+
+PlanePerspective PlanePerspective::same_box(std::string axis1, std::string axis2) const
+{
+  PlanePerspective ret(axis1, axis2);
+  if (!buffer_.empty())
+    ret.fit(row_base_, row_base_ + rows_ - 1, col_base_, col_base_ + cols_ - 1);
+  return ret;
 }
 
 uint16_t PlanePerspective::span() const
@@ -64,11 +171,24 @@ uint16_t PlanePerspective::span() const
 
 HistList2D PlanePerspective::points(bool flip) const
 {
-  if (!flip)
-    return point_list_;
   HistList2D ret;
-  for (auto p : point_list_)
-    ret.push_back(p2d{p.y, p.x, p.v});
+  for (size_t r = 0; r < rows_; ++r)
+  {
+    if (!row_counts_[r])
+      continue;
+    uint32_t idx = row_base_ + r;
+    const int16_t* row = buffer_.data() + r * cols_;
+    for (size_t c = 0; c < cols_; ++c)
+    {
+      if (!row[c])
+        continue;
+      uint32_t sample = col_base_ + c;
+      if (flip)
+        ret.push_back(p2d{sample, idx, static_cast<double>(row[c])});
+      else
+        ret.push_back(p2d{idx, sample, static_cast<double>(row[c])});
+    }
+  }
   return ret;
 }
 
@@ -77,15 +197,17 @@ HistList1D PlanePerspective::projection() const
   HistList1D ret;
   for (auto i = start_; i <= end_; ++i)
   {
-    if (data_.count(i))
-      ret.push_back({i, data_.at(i).integral()});
+    size_t row = i - row_base_;
+    if ((i >= row_base_) && (row < rows_) && row_counts_[row])
+      ret.push_back({i, row_integrals_[row]});
     else
       ret.push_back({i, 0});
   }
   return ret;
 }
 
-PlanePerspective PlanePerspective::subset(std::string name, Settings params) const
+PlanePerspective PlanePerspective::subset(std::string name,
+                                          const PerspectiveParams& params) const
 {
   if (name == "orthogonal")
     return orthogonal();
@@ -94,120 +216,252 @@ PlanePerspective PlanePerspective::subset(std::string name, Settings params) con
     return suppress_negatives();
 
   if (name == "best")
-    return pick_best(params.get_value("best_max_bincount"),
-                     params.get_value("best_max_binspan"));
+    return pick_best(params.best_max_bincount, params.best_max_binspan);
+
+  if (name == "maxima")
+    return transform<StripMaxima>(params);
 
-  PlanePerspective ret(axis1_, axis2_);
+  if (name == "vmm")
+    return transform<StripVMM>(params);
 
-  int cuness_min_span = params.get_value("cuness_min_span");
-  for (auto &d : data_)
+  if (name == "peak_separation")
+    return transform<StripPeakSeparation>(params);
+
+  return transform<StripAll>(params);
+}
+
+template<typename Stage>
+PlanePerspective PlanePerspective::transform(const PerspectiveParams& params) const
+{
+  //subsets never reach outside the original samples
+  PlanePerspective ret = same_box(axis1_, axis2_);
+
+  //stages see each strip from sample 0 to its last valid one,
+  //as Strip::subset would
+  std::vector<int16_t> samples(col_base_ + cols_, 0);
+  std::vector<int16_t> kept(samples.size(), 0);
+  for (size_t r = 0; r < rows_; ++r)
   {
-    Strip newstrip = d.second.subset(name, params);
-    if (!newstrip.empty())
-      ret.add_data(d.first, newstrip);
-    int cu = newstrip.num_valid() - 1;
-    if (cu < 0)
-      cu = 0;
-    ret.cuness_ += cu;
-    if (int(newstrip.span()) >= cuness_min_span)
-      ret.cuness2_ += cu;
+    if (!row_counts_[r])
+      continue;
+    const int16_t* row = buffer_.data() + r * cols_;
+    size_t count = cols_;
+    while (!row[count - 1])
+      --count;
+    std::copy(row, row + count, samples.begin() + col_base_);
+    size_t n = col_base_ + count;
+
+    int valid {0};
+    size_t first {0};
+    size_t lo = n;
+    size_t hi {0};
+    Stage::apply(samples.data(), n, params, [&](size_t i, int16_t val)
+    {
+      if (!val || kept[i])
+        return;
+      if (!valid)
+        first = i;
+      kept[i] = val;
+      valid++;
+      lo = std::min(lo, i);
+      hi = std::max(hi, i);
+    });
+
+    ret.add_kept(row_base_ + r, kept.data(), lo, hi, first, valid,
+                 params.cuness_min_span);
+    if (valid)
+      std::fill(kept.begin() + lo, kept.begin() + hi + 1, 0);
   }
   return ret;
 }
 
+void PlanePerspective::add_subset(int16_t idx, const int16_t* samples,
+                                  size_t count, int cuness_min_span)
+{
+  int valid {0};
+  size_t lo {0};
+  size_t hi {0};
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (!samples[i])
+      continue;
+    if (!valid)
+      lo = i;
+    hi = i;
+    valid++;
+  }
+  add_kept(idx, samples, lo, hi, lo, valid, cuness_min_span);
+}
+
+void PlanePerspective::add_kept(int16_t idx, const int16_t* samples,
+                                size_t lo, size_t hi, size_t first,
+                                int valid, int cuness_min_span)
+{
+  //span as Strip reports it, from the first sample kept
+  int span {0};
+  if (valid)
+  {
+    span = hi - first + 1;
+    add_row(idx, samples + lo, lo, hi - lo + 1);
+  }
+
+  int cu = std::max(valid - 1, 0);
+  cuness_ += cu;
+  if (span >= cuness_min_span)
+    cuness2_ += cu;
+}
+
+template PlanePerspective PlanePerspective::transform<StripAll>(const PerspectiveParams&) const;
+template PlanePerspective PlanePerspective::transform<StripMaxima>(const PerspectiveParams&) const;
+template PlanePerspective PlanePerspective::transform<StripVMM>(const PerspectiveParams&) const;
+template PlanePerspective PlanePerspective::transform<StripPeakSeparation>(const PerspectiveParams&) const;
+template PlanePerspective PlanePerspective::transform<Separated<StripVMM>>(const PerspectiveParams&) const;
 
 PlanePerspective PlanePerspective::suppress_negatives() const
 {
-  PlanePerspective ret(axis1_, axis2_);
-  for (auto s : data_)
-    ret.add_data(s.first, s.second.suppress_negatives());
+  PlanePerspective ret = same_box(axis1_, axis2_);
+  std::vector<int16_t> row(cols_);
+  for (size_t r = 0; r < rows_; ++r)
+  {
+    if (!row_counts_[r])
+      continue;
+    const int16_t* from = buffer_.data() + r * cols_;
+    for (size_t c = 0; c < cols_; ++c)
+      row[c] = std::max(from[c], int16_t(0));
+    ret.add_row(row_base_ + r, row.data(), col_base_, cols_);
+  }
   return ret;
 }
 
 PlanePerspective PlanePerspective::orthogonal() const
 {
-  std::map<int16_t, std::map<uint16_t, int16_t>> sideways;
-  for (auto p : points())
-    sideways[p.y][p.x] = p.v;
-
   PlanePerspective ret(axis2_, axis1_);
-  for (auto n : sideways)
-    ret.add_data(n.first, Strip(n.second));
+  if (buffer_.empty())
+    return ret;
+  ret.fit(col_base_, col_base_ + cols_ - 1, row_base_, row_base_ + rows_ - 1);
+
+  //blocked transpose keeps both sides of the copy within cache
+  const size_t block {16};
+  std::vector<int16_t> sideways(buffer_.size());
+  for (size_t rb = 0; rb < rows_; rb += block)
+    for (size_t cb = 0; cb < cols_; cb += block)
+    {
+      size_t rend = std::min(rb + block, size_t(rows_));
+      size_t cend = std::min(cb + block, size_t(cols_));
+      for (size_t r = rb; r < rend; ++r)
+        for (size_t c = cb; c < cend; ++c)
+          sideways[c * rows_ + r] = buffer_[r * cols_ + c];
+    }
+
+  for (size_t c = 0; c < cols_; ++c)
+    ret.add_row(col_base_ + c, sideways.data() + c * rows_, row_base_, rows_);
   return ret;
 }
 
 PlanePerspective PlanePerspective::pick_best(int max_count, int max_span) const
 {
-  std::map<int, std::list<int>> best_candidates;
-  for (auto p : point_list_)
-    best_candidates[p.y].push_back(p.x);
-
-  std::map<int, std::map<uint16_t, int16_t>> best_candidates2;
+  //keep whole sample columns, starting from the latest one
+  std::vector<bool> keep(cols_, false);
   int levels {0};
   int latest {-1};
-  for (auto i = best_candidates.rbegin(); i != best_candidates.rend(); ++i)
+  for (size_t c = cols_; c > 0; --c)
   {
+    bool any {false};
+    for (size_t r = 0; r < rows_; ++r)
+      if (buffer_[r * cols_ + c - 1])
+      {
+        any = true;
+        break;
+      }
+    if (!any)
+      continue;
+
+    int sample = col_base_ + c - 1;
     levels++;
 
-    if ((levels > max_count) || ((latest - i->first) > max_span))
+    if ((levels > max_count) || ((latest - sample) > max_span))
       break;
 
     if (latest < 0)
-      latest = i->first;
+      latest = sample;
 
-    for (auto s : i->second)
-      best_candidates2[s][i->first] = data_.at(s).value(i->first);
+    keep[c - 1] = true;
   }
 
-  PlanePerspective ret(axis1_, axis2_);
-  for (auto n : best_candidates2)
-    ret.add_data(n.first, Strip(n.second));
+  PlanePerspective ret = same_box(axis1_, axis2_);
+  std::vector<int16_t> row(cols_);
+  for (size_t r = 0; r < rows_; ++r)
+  {
+    if (!row_counts_[r])
+      continue;
+    const int16_t* from = buffer_.data() + r * cols_;
+    for (size_t c = 0; c < cols_; ++c)
+      row[c] = keep[c] ? from[c] : 0;
+    ret.add_row(row_base_ + r, row.data(), col_base_, cols_);
+  }
   return ret;
 }
 
-MetricSet PlanePerspective::metrics() const
-{
-  MetricSet metrics;
-
-  metrics.set("min_c",
-      MetricVal(start_,
-              "minimum " + axis1_ + " with "));
+constexpr size_t PlanePerspective::metric_count;
 
-  metrics.set("max_c",
-      MetricVal(end_,
-              "maximum " + axis1_ + " with "));
-
-  metrics.set("valid",
-      MetricVal(data_.size(),
-              "number of " + axis1_ + "s with "));
+MetricSchema PlanePerspective::metric_schema(std::string axis1, std::string axis2)
+{
+  MetricSchema ret;
+  ret.add("min_c", "minimum " + axis1 + " with ");
+  ret.add("max_c", "maximum " + axis1 + " with ");
+  ret.add("valid", "number of " + axis1 + "s with ");
+  ret.add("valid_points", "number of valid points in " + axis1 + "s with ");
+  ret.add("span", "span of " + axis1 + "s with ");
+  ret.add("density", "% of " + axis1 + "s in span with ");
+  ret.add("integral", "integral of " + axis1 + "s with ");
+  ret.add("integral_density", "integral / valid for " + axis1 + " with ");
+  ret.add("integral_norm", "integral / valid_points for " + axis1 + " with ");
+  ret.add("cuness_", "number of points above 1 in " + axis1 + "s using ");
+  ret.add("cuness2", "number of points above 1 in " + axis1 + "s with span > cuness_min_span using ");
+  ret.add("average_c", axis1 + " average (no weights) using ");
+  ret.add("center_c", axis1 + " center of gravity using ");
+  ret.add("center_ortho_c", axis2 + "-weighted " + axis1 + " center of gravity using ");
+  ret.add("min_adc_c", axis1 + " with lowest adc using ");
+  ret.add("max_adc_c", axis1 + " with highest adc using ");
+  ret.add("center_inverse_c", axis1 + " inverse center of gravity using ");
+  ret.add("center_random_c", "random valid " + axis1 + " using ");
+  return ret;
+}
 
-  metrics.set("valid_points",
-      MetricVal(point_list_.size(),
-              "number of valid points in " + axis1_ + "s with "));
+MetricSet PlanePerspective::metrics() const
+{
+  MetricSet ret(std::make_shared<MetricSchema>(metric_schema(axis1_, axis2_)));
+  double values[metric_count];
+  metric_values(values);
+  for (size_t i = 0; i < metric_count; ++i)
+    ret.set(i, values[i]);
+  return ret;
+}
 
-  metrics.set("span",
-      MetricVal(span(),
-              "span of " + axis1_ + "s with "));
+void PlanePerspective::metric_values(double* values) const
+{
+  values[0] = start_;
+  values[1] = end_;
+  values[2] = num_strips_;
+  values[3] = num_points_;
+  values[4] = span();
 
   double strip_density {0};
   if (span() > 0)
-    strip_density = double(data_.size()) / double(span()) * 100.0;
-
-  metrics.set("density",
-      MetricVal(strip_density,
-              "% of " + axis1_ + "s in span with "));
+    strip_density = double(num_strips_) / double(span()) * 100.0;
+  values[5] = strip_density;
 
   double integral_per_hitstrips {0};
-  if (point_list_.size() > 0)
-    integral_per_hitstrips = double(integral_) / double(data_.size());
+  if (num_points_ > 0)
+    integral_per_hitstrips = double(integral_) / double(num_strips_);
 
   double integral_per_point {0};
-  if (data_.size() > 0)
-    integral_per_point = double(integral_) / double(point_list_.size());
+  if (num_strips_ > 0)
+    integral_per_point = double(integral_) / double(num_points_);
 
   double average {-1};
-  if (point_list_.size() > 0)
-    average = sum_idx_ / double(point_list_.size());
+  if (num_points_ > 0)
+    average = sum_idx_ / double(num_points_);
 
   double center_of_gravity {-1};
   if (integral_ > 0)
@@ -217,78 +471,47 @@ MetricSet PlanePerspective::metrics() const
   if (sum_ortho_ > 0)
     center_of_gravity_ortho = sum_idx_ortho_ / double(sum_ortho_);
 
-  metrics.set("integral",
-      MetricVal(integral_,
-              "integral of " + axis1_ + "s with "));
-
-  metrics.set("integral_density",
-      MetricVal(integral_per_hitstrips,
-              "integral / valid for " + axis1_ + " with "));
-
-  metrics.set("integral_norm",
-      MetricVal(integral_per_point,
-              "integral / valid_points for " + axis1_ + " with "));
-
-  metrics.set("cuness_",
-              MetricVal(cuness_,
-              "number of points above 1 in " + axis1_ + "s using "));
-
-  metrics.set("cuness2",
-              MetricVal(cuness2_,
-              "number of points above 1 in " + axis1_ + "s with span > cuness_min_span using "));
-
-  metrics.set("average_c",
-      MetricVal(average,
-              axis1_ + " average (no weights) using "));
-
-  metrics.set("center_c",
-      MetricVal(center_of_gravity,
-              axis1_ + " center of gravity using "));
-
-  metrics.set("center_ortho_c",
-      MetricVal(center_of_gravity_ortho,
-              axis2_ + "-weighted " + axis1_ + " center of gravity using "));
-
-  metrics.set("min_adc_c",
-      MetricVal(min_adc_idx_,
-              axis1_ + " with lowest adc using "));
-
-  metrics.set("max_adc_c",
-      MetricVal(max_adc_idx_,
-              axis1_ + " with highest adc using "));
+  values[6] = integral_;
+  values[7] = integral_per_hitstrips;
+  values[8] = integral_per_point;
+  values[9] = cuness_;
+  values[10] = cuness2_;
+  values[11] = average;
+  values[12] = center_of_gravity;
+  values[13] = center_of_gravity_ortho;
+  values[14] = min_adc_idx_;
+  values[15] = max_adc_idx_;
 
   double inv_num {0};
   double inv_denom {0};
-  for (auto d : data_)
+  for (size_t r = 0; r < rows_; ++r)
   {
-    double weight = (max_adc_ - d.second.integral() + 1);
-    inv_num += d.first * weight;
+    if (!row_counts_[r])
+      continue;
+    double weight = (max_adc_ - row_integrals_[r] + 1);
+    inv_num += (row_base_ + r) * weight;
     inv_denom += weight;
   }
   double inverse_center {-1};
   if (inv_denom != 0)
     inverse_center = inv_num / inv_denom;
-
-  metrics.set("center_inverse_c",
-      MetricVal(inverse_center,
-              axis1_ + " inverse center of gravity using "));
+  values[16] = inverse_center;
 
   double random_c {-1};
-  if (data_.size())
+  if (num_strips_)
   {
     std::random_device rd;
     std::mt19937 rng(rd());
-    std::uniform_int_distribution<size_t> uni(0, data_.size()-1);
-    auto it = data_.begin();
-    std::advance(it, uni(rng));
-    random_c = it->first;
+    std::uniform_int_distribution<size_t> uni(0, num_strips_-1);
+    size_t skip = uni(rng);
+    for (size_t r = 0; r < rows_; ++r)
+      if (row_counts_[r] && !skip--)
+      {
+        random_c = row_base_ + r;
+        break;
+      }
   }
-
-  metrics.set("center_random_c",
-      MetricVal(random_c,
-              "random valid " + axis1_ + " using "));
-
-  return metrics;
+  values[17] = random_c;
 }
 
 std::string PlanePerspective::debug() const
@@ -299,8 +522,9 @@ std::string PlanePerspective::debug() const
   else
     ss << "No valid range\n";
 
-  for (auto &s : data_)
-    ss << std::setw(5) << s.first << "  =  " << s.second.debug() << std::endl;
+  for (size_t r = 0; r < rows_; ++r)
+    if (row_counts_[r])
+      ss << std::setw(5) << (row_base_ + r) << "  =  " << strip(r).debug() << std::endl;
 
   return ss.str();
 }
@@ -8,21 +8,51 @@
 namespace NMX
 {
 
+//PlanePerspective::default_params() compiled for per-event use
+struct PerspectiveParams : StripParams
+{
+  PerspectiveParams() {}
+  explicit PerspectiveParams(const Settings& settings);
+
+  int cuness_min_span {2};
+  int best_max_bincount {3};
+  int best_max_binspan {5};
+};
+
 struct PlanePerspective
 {
   PlanePerspective(std::string axis1, std::string axis2)
     : axis1_(axis1), axis2_(axis2) {}
 
   static Settings default_params();
-  PlanePerspective subset(std::string name, Settings params = Settings()) const;
+  PlanePerspective subset(std::string name,
+                          const PerspectiveParams& params = PerspectiveParams()) const;
+
+  //statically typed subsets, see StripStages.h for the strip stages
+  template<typename Stage>
+  PlanePerspective transform(const PerspectiveParams& params) const;
+  PlanePerspective pick_best(int max_count, int max_span) const;
+  PlanePerspective suppress_negatives() const;
+  PlanePerspective orthogonal() const;
+
+  //adds samples[0, count) of the strip at idx as the subset it was reduced
+  //to, counting cuness as subset() does
+  void add_subset(int16_t idx, const int16_t* samples, size_t count,
+                  int cuness_min_span);
+
   void add_data(int16_t idx, const Strip &strip);
 
-  bool empty() const { return data_.empty(); }
+  bool empty() const { return !num_strips_; }
   int16_t start() const { return start_; }
   int16_t end() const { return end_; }
   uint16_t  span() const;
 
   MetricSet metrics() const;
+
+  //names and descriptions of metrics(), in the order of metric_values()
+  static MetricSchema metric_schema(std::string axis1, std::string axis2);
+  static constexpr size_t metric_count {18};
+  void metric_values(double* values) const;
   HistList2D points(bool flip = false) const;
   HistList1D projection() const;
 
@@ -31,15 +61,25 @@ struct PlanePerspective
 private:
   std::string axis1_;
   std::string axis2_;
-  std::map<int16_t , Strip> data_;
+
+  //strips [row_base_, row_base_ + rows_) by samples [col_base_, col_base_ + cols_),
+  //row-major, zero where there is no value
+  std::vector<int16_t> buffer_;
+  int16_t  row_base_ {0};
+  uint16_t rows_     {0};
+  uint16_t col_base_ {0};
+  uint16_t cols_     {0};
+
+  std::vector<int64_t>  row_integrals_;
+  std::vector<uint16_t> row_counts_;    //valid samples, 0 where there is no strip
+  size_t num_strips_ {0};
+  size_t num_points_ {0};
 
   int16_t start_ {-1};
   int16_t end_   {-1};
   int16_t max_adc_idx_ {-1};
   int16_t min_adc_idx_ {-1};
 
-  HistList2D point_list_;
-
   int32_t integral_ {0};
   int32_t sum_idx_ {0};
   double sum_idx_val_ {0};
@@ -51,10 +91,13 @@ private:
   int64_t min_adc_   {std::numeric_limits<int64_t>::max()};
   int64_t max_adc_   {std::numeric_limits<int64_t>::min()};
 
-  PlanePerspective pick_best(int max_count, int max_span) const;
-  PlanePerspective suppress_negatives() const;
-  PlanePerspective orthogonal() const;
-
+  void fit(int16_t row_lo, int16_t row_hi, uint16_t col_lo, uint16_t col_hi);
+  void add_row(int16_t idx, const int16_t* samples, uint16_t first, size_t count);
+  Strip strip(size_t row) const;
+  PlanePerspective same_box(std::string axis1, std::string axis2) const;
+  void add_kept(int16_t idx, const int16_t* samples,
+                size_t lo, size_t hi, size_t first,
+                int valid, int cuness_min_span);
 };
 
 }
@@ -0,0 +1,108 @@
+#include "Prefetcher.h"
+#include <algorithm>
+
+namespace NMX {
+
+std::mutex& io_mutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+Prefetcher::Prefetcher(std::shared_ptr<Raw> raw, size_t depth)
+  : raw_(raw)
+  , depth_(std::max(depth, size_t(1)))
+{
+  if (raw_)
+    event_count_ = raw_->event_count();
+}
+
+Prefetcher::~Prefetcher()
+{
+  stop();
+}
+
+Event Prefetcher::get_event(size_t index)
+{
+  if (!raw_ || (index >= event_count_))
+    return Event();
+
+  if (!thread_.joinable() || (index != next_out_))
+    start(index);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this]{ return !ring_.empty() || done_; });
+  if (ring_.empty() && error_)
+  {
+    auto error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+  if (ring_.empty())
+  {
+    lock.unlock();
+    std::lock_guard<std::mutex> io(io_mutex());
+    return raw_->get_event(index);
+  }
+
+  Event ret = std::move(ring_.front());
+  ring_.pop_front();
+  next_out_++;
+  cond_.notify_all();
+  return ret;
+}
+
+void Prefetcher::start(size_t index)
+{
+  stop();
+  ring_.clear();
+  next_in_ = next_out_ = index;
+  stop_ = done_ = false;
+  error_ = nullptr;
+  thread_ = std::thread(&Prefetcher::run, this);
+}
+
+void Prefetcher::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void Prefetcher::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    cond_.wait(lock, [this]{ return stop_ || (ring_.size() < depth_); });
+    if (stop_ || (next_in_ >= event_count_))
+      break;
+    size_t index = next_in_++;
+    lock.unlock();
+
+    Event event;
+    try
+    {
+      std::lock_guard<std::mutex> io(io_mutex());
+      event = raw_->get_event(index);
+    }
+    catch (...)
+    {
+      lock.lock();
+      error_ = std::current_exception();
+      break;
+    }
+
+    lock.lock();
+    ring_.push_back(std::move(event));
+    cond_.notify_all();
+  }
+  done_ = true;
+  cond_.notify_all();
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Raw.h"
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace NMX {
+
+/** @brief serializes HDF5 calls made from more than one thread,
+ *  the library is not built thread-safe
+ */
+std::mutex& io_mutex();
+
+/** @brief reads and decodes raw events ahead of the caller on a
+ *  background thread, keeping at most depth events in memory
+ */
+class Prefetcher
+{
+public:
+  Prefetcher(std::shared_ptr<Raw> raw, size_t depth);
+  ~Prefetcher();
+
+  /** @brief returns raw event at index; sequential access is served from
+   *  the read-ahead ring, any jump restarts read-ahead from index;
+   *  rethrows what the read-ahead thread failed with at that point
+   */
+  Event get_event(size_t index);
+
+  size_t depth() const { return depth_; }
+
+private:
+  std::shared_ptr<Raw> raw_;
+  size_t depth_ {1};
+  size_t event_count_ {0};
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Event> ring_;
+  size_t next_in_ {0};
+  size_t next_out_ {0};
+  bool stop_ {false};
+  bool done_ {false};
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  void start(size_t index);
+  void stop();
+  void run();
+};
+
+}
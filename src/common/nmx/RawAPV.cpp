@@ -71,6 +71,17 @@ Plane RawAPV::read_record(size_t index, size_t plane) const
     return Plane();
 }
 
+APVBatch RawAPV::read_batch(size_t start, size_t count) const
+{
+  if (start >= event_count())
+    return APVBatch();
+  count = std::min(count, event_count() - start);
+  auto shape = dataset_APV_.shape();
+  return APVBatch(start, shape.dim(2), shape.dim(3),
+                  dataset_APV_.read<int16_t>({count, 2, H5CC::kMax, H5CC::kMax},
+                                             {start, 0, 0, 0}));
+}
+
 void RawAPV::write_record(size_t index, size_t plane, const Plane& record)
 {
   auto strips = dataset_APV_.shape().dim(2);
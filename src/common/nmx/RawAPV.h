@@ -2,6 +2,7 @@
 
 #include "H5CC_File.h"
 #include "Raw.h"
+#include "APVBatch.h"
 
 namespace NMX {
 
@@ -16,6 +17,9 @@ public:
   Event get_event(size_t index) const override;
   void write_event(size_t index, const Event& event) override;
 
+  //events [start, start + count) in one read, fewer at the end of the data
+  APVBatch read_batch(size_t start, size_t count) const;
+
 protected:
   bool write_access_ {false};
   H5CC::DataSet  dataset_APV_;
@@ -18,16 +18,25 @@ RawClustered::RawClustered(H5CC::File& file)
 }
 
 RawClustered::RawClustered(H5CC::File& file, hsize_t events, size_t chunksize)
+  : RawClustered(file, events, ChunkPolicy::fixed_rows(chunksize))
+{}
+
+RawClustered::RawClustered(H5CC::File& file, hsize_t events, ChunkPolicy chunking,
+                           RawVMM::Layout layout)
 {
-  unclustered_ = RawVMM(file, chunksize);
+  unclustered_ = RawVMM(file, chunking, layout);
 
   bool write = (file.status() != H5CC::Access::r_existing) &&
                (file.status() != H5CC::Access::no_access);
   if (write && events > 0)
   {
+    hsize_t chunk_rows = std::min<hsize_t>(events,
+                                           chunking.rows(4 * sizeof(uint64_t)));
+    chunking.create_filtered(file, "RawVMM/indices", sizeof(uint64_t),
+                             {events, 4}, {chunk_rows, 4});
     indices_VMM_ = file.require_group("RawVMM").require_dataset<uint64_t>("indices",
-                                                {events, 4},
-                                                {1,      4});
+                                                {events,     4},
+                                                {chunk_rows, 4});
     write_access_ = write;
     event_count_ = 0;
   }
@@ -49,7 +58,16 @@ size_t RawClustered::event_count() const
 
 Event RawClustered::get_event(size_t index) const
 {
-  return Event(this->read_record(index, 0), this->read_record(index, 1));
+  if (index >= event_count())
+    return Event();
+
+  //start and stop for both planes in one read
+  auto bounds = indices_VMM_.read<uint64_t>({1, 4}, {index, 0});
+  if (bounds.size() != 4)
+    return Event();
+
+  return Event(this->read_record(bounds[0], bounds[1]),
+               this->read_record(bounds[2], bounds[3]));
 }
 
 void RawClustered::write_event(size_t index, const Event& event)
@@ -61,39 +79,34 @@ void RawClustered::write_event(size_t index, const Event& event)
   }
 }
 
-Plane RawClustered::read_record(size_t index, size_t plane) const
+Plane RawClustered::read_record(size_t start, size_t stop) const
 {
-  if (index < event_count())
-  {
-    size_t start = indices_VMM_.read<uint64_t>({index, 2*plane});
-    size_t stop = indices_VMM_.read<uint64_t>({index, 2*plane + 1});
-
-    //strip->(timebin->adc)
-    std::map<int16_t, std::map<uint16_t, int16_t>> strips;
+  //whole slab in one read
+  EventletPacket packet;
+  unclustered_.read_range(start, stop, packet);
 
-    for (size_t i = start; i < stop; ++i)
-    {
-      auto evt = unclustered_.read_eventlet(i);
-      //if (data.at(0) != index) //assume clustered
-      //  continue;
-      strips[evt.strip][evt.time & 0xFF] = evt.adc;
-    }
+  //strip->(timebin->adc)
+  std::map<int16_t, std::map<uint16_t, int16_t>> strips;
+  for (const auto& evt : packet.eventlets)
+    strips[evt.strip][evt.time & 0xFF] = evt.adc;
 
-    Plane record;
-    for (const auto& s : strips)
-      record.add_strip(s.first, Strip(s.second));
-    return record;
-  }
-  else
-    return Plane();
+  Plane record;
+  for (const auto& s : strips)
+    record.add_strip(s.first, Strip(s.second));
+  return record;
 }
 
 void RawClustered::write_record(size_t index, size_t plane, const Plane& record)
+{
+  write_maxima(index, plane, record.get_points("strip_vmm"));
+}
+
+void RawClustered::write_maxima(size_t index, size_t plane, const HistList2D& maxima)
 {
   if (write_access_)
   {
     size_t start = unclustered_.eventlet_count();
-    for (auto p : record.get_points("strip_vmm"))
+    for (auto p : maxima)
     {
       Eventlet evt;
       evt.time = static_cast<uint64_t>(index << 8) | static_cast<uint64_t>(p.y);
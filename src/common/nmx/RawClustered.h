@@ -10,6 +10,8 @@ class RawClustered : public Raw
 public:
   RawClustered(H5CC::File& file);
   RawClustered(H5CC::File& file, hsize_t events, size_t chunksize);
+  RawClustered(H5CC::File& file, hsize_t events, ChunkPolicy chunking,
+               RawVMM::Layout layout = RawVMM::Layout::plain);
   static bool exists_in(const H5CC::File& file);
 
   virtual ~RawClustered() {}
@@ -17,6 +19,8 @@ public:
   size_t event_count() const override;
   Event get_event(size_t index) const override;
   void write_event(size_t index, const Event& event) override;
+  //as write_event for one plane whose "strip_vmm" points are maxima
+  void write_maxima(size_t index, size_t plane, const HistList2D& maxima);
 
 protected:
   bool write_access_ {false};
@@ -25,7 +29,7 @@ protected:
 
   RawVMM unclustered_;
 
-  Plane read_record(size_t index, size_t plane) const;
+  Plane read_record(size_t start, size_t stop) const;
   void write_record(size_t index, size_t plane, const Plane&);
 };
 
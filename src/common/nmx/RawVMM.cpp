@@ -1,37 +1,157 @@
 #include "RawVMM.h"
 #include "CustomLogger.h"
+#include <algorithm>
+#include <utility>
 
 namespace NMX {
 
+constexpr size_t RawVMM::default_buffer_size;
+constexpr size_t RawVMM::row_bytes;
+constexpr size_t RawVMM::compact_block_size;
+
 RawVMM::RawVMM(H5CC::File& file)
 {
-  if (exists_in(file))
+  if (compact_in(file))
+    open_compact(file);
+  else if (exists_in(file))
   {
     dataset_VMM_ = file.open_dataset("RawVMM/points");
-    entry_count_ = dataset_VMM_.shape().dim(0);
+    entry_count_ = flushed_count_ = dataset_VMM_.shape().dim(0);
   }
   else
     ERR << "<NMX::RawVMM> bad size for raw/VMM datset " << dataset_VMM_.debug();
 }
 
-RawVMM::RawVMM(H5CC::File& file, size_t chunksize)
+RawVMM::RawVMM(H5CC::File& file, size_t chunksize, size_t buffer_size)
+  : RawVMM(file, ChunkPolicy::fixed_rows(chunksize), Layout::plain, buffer_size)
+{}
+
+RawVMM::RawVMM(H5CC::File& file, ChunkPolicy chunking,
+               Layout layout, size_t buffer_size)
 {
+  hsize_t chunk_rows = chunking.rows(row_bytes);
+
+  //flush whole chunks at a time
+  buffer_size_ = std::max<size_t>(buffer_size, chunk_rows);
+
+  //keep appending in whatever layout is already there
+  if (compact_in(file) ||
+      ((layout == Layout::compact) && !file.has_dataset("RawVMM/points")))
+  {
+    auto grp = file.require_group("RawVMM").require_group("compact");
+    chunking.create_filtered(file, "RawVMM/compact/blocks", sizeof(uint64_t),
+                             {H5CC::kMax, 4}, {1024, 4});
+    dataset_blocks_ = grp.require_dataset<uint64_t>("blocks",
+                                                    {H5CC::kMax, 4},
+                                                    {1024, 4});
+    //same bytes per chunk as the plain layout would have
+    chunking.create_filtered(file, "RawVMM/compact/words", sizeof(uint32_t),
+                             {H5CC::kMax}, {chunk_rows * 4});
+    dataset_words_ = grp.require_dataset<uint32_t>("words",
+                                                   {H5CC::kMax},
+                                                   {chunk_rows * 4});
+    open_compact(file);
+    return;
+  }
+
   auto grp = file.require_group("RawVMM");
 
+  chunking.create_filtered(file, "RawVMM/points", sizeof(uint32_t),
+                           {H5CC::kMax, 4}, {chunk_rows, 4});
   dataset_VMM_ = grp.require_dataset<uint32_t>("points",
                                                {H5CC::kMax, 4},
-                                               {chunksize , 4});
-  entry_count_ = 0;
+                                               {chunk_rows, 4});
+  entry_count_ = flushed_count_ = dataset_VMM_.shape().dim(0);
+}
+
+RawVMM::~RawVMM()
+{
+  try
+  {
+    flush();
+  }
+  catch (...)
+  {
+    if (layout_ == Layout::compact)
+      ERR << "<NMX::RawVMM> failed to flush " << write_buffer_.eventlets.size()
+          << " buffered eventlets to " << dataset_words_.debug()
+          << " and " << dataset_blocks_.debug();
+    else
+      ERR << "<NMX::RawVMM> failed to flush " << write_buffer_.eventlets.size()
+          << " buffered eventlets to " << dataset_VMM_.debug();
+  }
+}
+
+RawVMM::RawVMM(RawVMM&& other)
+{
+  *this = std::move(other);
+}
+
+RawVMM& RawVMM::operator=(RawVMM&& other)
+{
+  if (this == &other)
+    return *this;
+
+  //what is still buffered here belongs to the old dataset
+  flush();
+
+  layout_ = other.layout_;
+  dataset_VMM_ = std::move(other.dataset_VMM_);
+  entry_count_ = other.entry_count_;
+  dataset_blocks_ = std::move(other.dataset_blocks_);
+  dataset_words_ = std::move(other.dataset_words_);
+  blocks_ = std::move(other.blocks_);
+  word_count_ = other.word_count_;
+  flushed_count_ = other.flushed_count_;
+  buffer_size_ = other.buffer_size_;
+  write_buffer_ = std::move(other.write_buffer_);
+  h5_buffer_ = std::move(other.h5_buffer_);
+
+  other.write_buffer_.eventlets.clear();
+  other.entry_count_ = other.flushed_count_;
+  return *this;
 }
 
 bool RawVMM::exists_in(const H5CC::File& file)
 {
+  if (compact_in(file))
+    return true;
   if (!file.has_dataset("RawVMM/points"))
     return false;
   auto shape = file.open_dataset("RawVMM/points").shape();
   return ((shape.rank() == 2) && (shape.dim(1) == 4));
 }
 
+bool RawVMM::compact_in(const H5CC::File& file)
+{
+  if (!file.has_dataset("RawVMM/compact/blocks") ||
+      !file.has_dataset("RawVMM/compact/words"))
+    return false;
+  auto shape = file.open_dataset("RawVMM/compact/blocks").shape();
+  return ((shape.rank() == 2) && (shape.dim(1) == 4) &&
+          (file.open_dataset("RawVMM/compact/words").shape().rank() == 1));
+}
+
+void RawVMM::open_compact(const H5CC::File& file)
+{
+  layout_ = Layout::compact;
+  dataset_blocks_ = file.open_dataset("RawVMM/compact/blocks");
+  dataset_words_ = file.open_dataset("RawVMM/compact/words");
+  word_count_ = dataset_words_.shape().dim(0);
+
+  //block index is small, keep all of it for random access
+  blocks_.clear();
+  size_t num_blocks = dataset_blocks_.shape().dim(0);
+  if (num_blocks)
+  {
+    auto rows = dataset_blocks_.read<uint64_t>({num_blocks, H5CC::kMax}, {0, 0});
+    for (size_t i = 0; (i + 3) < rows.size(); i += 4)
+      blocks_.push_back(CompactBlock::from_h5(&rows[i]));
+  }
+
+  entry_count_ = flushed_count_ = blocks_.empty() ? 0 : blocks_.back().end_row();
+}
+
 size_t RawVMM::eventlet_count() const
 {
   return entry_count_;
@@ -39,36 +159,131 @@ size_t RawVMM::eventlet_count() const
 
 void RawVMM::write_eventlet(const Eventlet &packet)
 {
-  dataset_VMM_.write(packet.to_h5(), {1,H5CC::kMax},
-                                         {dataset_VMM_.shape().dim(0), 0});
-  entry_count_ = dataset_VMM_.shape().dim(0);
+  write_buffer_.eventlets.push_back(packet);
+  entry_count_++;
+  if (write_buffer_.eventlets.size() >= buffer_size_)
+    flush();
 }
 
 Eventlet RawVMM::read_eventlet(size_t i) const
 {
-  if (i < entry_count_)
+  if ((i < flushed_count_) && (layout_ == Layout::compact))
+  {
+    std::vector<Eventlet> out;
+    read_compact(i, i + 1, out);
+    return out.empty() ? Eventlet() : out.front();
+  }
+  else if (i < flushed_count_)
     return Eventlet::from_h5(dataset_VMM_.read<uint32_t>({1,H5CC::kMax}, {i, 0}));
+  else if (i < entry_count_)
+    return write_buffer_.eventlets[i - flushed_count_];
   else
     return Eventlet();
 }
 
+void RawVMM::read_range(size_t start, size_t stop, EventletPacket& packet) const
+{
+  packet.clear_and_keep_capacity();
+  stop = std::min(stop, entry_count_);
+
+  size_t on_disk = std::min(stop, flushed_count_);
+  if ((start < on_disk) && (layout_ == Layout::compact))
+    read_compact(start, on_disk, packet.eventlets);
+  else if (start < on_disk)
+    packet.from_h5(dataset_VMM_.read<uint32_t>({on_disk - start, H5CC::kMax}, {start, 0}));
+
+  for (size_t i = std::max(start, flushed_count_); i < stop; ++i)
+    packet.eventlets.push_back(write_buffer_.eventlets[i - flushed_count_]);
+}
+
 void RawVMM::write_packet(const EventletPacket& packet)
 {
-  dataset_VMM_.write(packet.to_h5(), {packet.eventlets.size(),H5CC::kMax},
-                                         {dataset_VMM_.shape().dim(0), 0});
-  entry_count_ = dataset_VMM_.shape().dim(0);
+  write_buffer_.eventlets.insert(write_buffer_.eventlets.end(),
+                                 packet.eventlets.begin(), packet.eventlets.end());
+  entry_count_ += packet.eventlets.size();
+  if (write_buffer_.eventlets.size() >= buffer_size_)
+    flush();
 }
 
 void RawVMM::read_packet(size_t i, EventletPacket& packet) const
 {
   if (i < entry_count_)
+    read_range(i, i + packet.eventlets.capacity(), packet);
+}
+
+void RawVMM::flush()
+{
+  if (write_buffer_.eventlets.empty())
+    return;
+  if (layout_ == Layout::compact)
+  {
+    flush_compact();
+    return;
+  }
+  write_buffer_.to_h5(h5_buffer_);
+  dataset_VMM_.write(h5_buffer_, {write_buffer_.eventlets.size(), H5CC::kMax},
+                                 {flushed_count_, 0});
+  flushed_count_ += write_buffer_.eventlets.size();
+  write_buffer_.clear_and_keep_capacity();
+}
+
+void RawVMM::read_compact(size_t start, size_t stop,
+                          std::vector<Eventlet>& out) const
+{
+  auto by_row = [](uint64_t row, const CompactBlock& b) { return row < b.first_row; };
+  auto first = std::upper_bound(blocks_.begin(), blocks_.end(), start, by_row);
+  auto last = std::upper_bound(blocks_.begin(), blocks_.end(), stop - 1, by_row);
+  if (first == blocks_.begin())
+    return;
+  --first;
+  --last;
+
+  //packed words for all blocks in range, in one read
+  size_t word_start = first->word_offset;
+  size_t word_stop = last->word_offset + last->word_count();
+  std::vector<uint32_t> words;
+  if (word_stop > word_start)
+    words = dataset_words_.read<uint32_t>({word_stop - word_start}, {word_start});
+  words.resize(word_stop - word_start + 1, 0);
+
+  for (auto b = first; b <= last; ++b)
   {
-    size_t num = std::min(packet.eventlets.capacity(), entry_count_ - i);
-    packet.clear_and_keep_capacity();
-    packet.from_h5(dataset_VMM_.read<uint32_t>({num,H5CC::kMax}, {i, 0}));
+    size_t skip = (start > b->first_row) ? (start - b->first_row) : 0;
+    size_t num = std::min<size_t>(stop, b->end_row()) - b->first_row - skip;
+    b->decode(&words[b->word_offset - word_start], skip, num, out);
   }
 }
 
+void RawVMM::flush_compact()
+{
+  const auto& eventlets = write_buffer_.eventlets;
+  size_t num_blocks = blocks_.size();
 
+  h5_buffer_.clear();
+  for (size_t i = 0; i < eventlets.size(); i += compact_block_size)
+  {
+    auto block = CompactBlock::encode(&eventlets[i],
+                                      std::min(compact_block_size, eventlets.size() - i),
+                                      flushed_count_ + i, h5_buffer_);
+    block.word_offset += word_count_;
+    blocks_.push_back(block);
+  }
+
+  std::vector<uint64_t> rows, row;
+  for (size_t i = num_blocks; i < blocks_.size(); ++i)
+  {
+    blocks_[i].to_h5(row);
+    rows.insert(rows.end(), row.begin(), row.end());
+  }
+
+  if (!h5_buffer_.empty())
+    dataset_words_.write(h5_buffer_, {h5_buffer_.size()}, {word_count_});
+  dataset_blocks_.write(rows, {blocks_.size() - num_blocks, H5CC::kMax},
+                              {num_blocks, 0});
+
+  word_count_ += h5_buffer_.size();
+  flushed_count_ += eventlets.size();
+  write_buffer_.clear_and_keep_capacity();
+}
 
 }
@@ -2,30 +2,77 @@
 
 #include "H5CC_File.h"
 #include "EventletPacket.h"
+#include "CompactBlock.h"
+#include "ChunkPolicy.h"
 
 namespace NMX {
 
 class RawVMM
 {
 public:
+  /** plain: RawVMM/points, 4 x uint32 per eventlet
+   *  compact: RawVMM/compact/words, delta-encoded and bit-packed
+   *           in blocks indexed by RawVMM/compact/blocks
+   */
+  enum class Layout { plain, compact };
+
   RawVMM() {}
   RawVMM(H5CC::File& file);
-  RawVMM(H5CC::File& file, size_t chunksize);
+  RawVMM(H5CC::File& file, size_t chunksize,
+         size_t buffer_size = default_buffer_size);
+  RawVMM(H5CC::File& file, ChunkPolicy chunking,
+         Layout layout = Layout::plain,
+         size_t buffer_size = default_buffer_size);
   static bool exists_in(const H5CC::File& file);
+  static bool compact_in(const H5CC::File& file);
+
+  virtual ~RawVMM();
+
+  //buffered eventlets belong to one writer, the moved-from one has none
+  RawVMM(const RawVMM&) = delete;
+  RawVMM& operator=(const RawVMM&) = delete;
+  RawVMM(RawVMM&& other);
+  RawVMM& operator=(RawVMM&& other);
 
-  virtual ~RawVMM() {}
+  Layout layout() const { return layout_; }
 
   size_t eventlet_count() const;
   void write_eventlet(const Eventlet& packet);
   Eventlet read_eventlet(size_t index) const;
+  void read_range(size_t start, size_t stop, EventletPacket& packet) const;
 
   void write_packet(const EventletPacket& packet);
   void read_packet(size_t i, EventletPacket& packet) const;
 
+  /** @brief writes out all buffered eventlets with a single dataset extension
+   */
+  void flush();
+
+  static constexpr size_t default_buffer_size {65536};
+  static constexpr size_t row_bytes {4 * sizeof(uint32_t)};
+  static constexpr size_t compact_block_size {4096};
+
 protected:
+  Layout layout_ {Layout::plain};
   H5CC::DataSet  dataset_VMM_;
   size_t entry_count_ {0};
+
+  //compact layout
+  H5CC::DataSet  dataset_blocks_;
+  H5CC::DataSet  dataset_words_;
+  std::vector<CompactBlock> blocks_;
+  size_t word_count_ {0};
+
+  //write-behind buffer, eventlets past flushed_count_ are not yet on disk
+  size_t flushed_count_ {0};
+  size_t buffer_size_ {default_buffer_size};
+  EventletPacket write_buffer_;
+  std::vector<uint32_t> h5_buffer_;
+
+  void open_compact(const H5CC::File& file);
+  void read_compact(size_t start, size_t stop,
+                    std::vector<Eventlet>& out) const;
+  void flush_compact();
 };
 
 }
-
@@ -19,6 +19,15 @@ public:
   nlohmann::json get(std::string name) const;
   nlohmann::json get_value(std::string name) const;
 
+  //numeric or boolean value, fallback if absent or of another type
+  template<typename T> T value_or(std::string name, T fallback) const
+  {
+    auto v = get_value(name);
+    if (v.is_number() || v.is_boolean())
+      return v.template get<T>();
+    return fallback;
+  }
+
   void set(std::string name, nlohmann::json v, std::string descr = "");
 
   void clear() { data_.clear(); }
@@ -1,4 +1,5 @@
 #include "Strip.h"
+#include "StripStages.h"
 
 #include <iomanip>
 #include <sstream>
@@ -8,21 +9,34 @@
 
 namespace NMX {
 
+StripParams::StripParams(const Settings& settings)
+{
+  threshold = settings.value_or("threshold", threshold);
+  over_threshold = settings.value_or("over_threshold", over_threshold);
+  min_peak_separation = settings.value_or("min_peak_separation", min_peak_separation);
+}
+
 Settings Strip::default_params()
 {
+  StripParams defaults;
   Settings ret;
-  ret.set("threshold", 150, "Minimum ADC value for maxima");
-  ret.set("over_threshold", 3, "Minimum number of bins above threshold for maxima");
-  ret.set("min_peak_separation", 0, "Minimum separation between peaks");
+  ret.set("threshold", defaults.threshold, "Minimum ADC value for maxima");
+  ret.set("over_threshold", defaults.over_threshold, "Minimum number of bins above threshold for maxima");
+  ret.set("min_peak_separation", defaults.min_peak_separation, "Minimum separation between peaks");
   return ret;
 }
 
 
 void Strip::add_value(int16_t idx, int16_t val)
 {
-  if ((idx < 0) || !val || data_.count(idx))
+  if ((idx < 0) || !val)
+    return;
+  if (static_cast<size_t>(idx) >= data_.size())
+    data_.resize(idx + 1, 0);
+  else if (data_[idx])
     return;
   data_[idx] = val;
+  num_valid_++;
   integral_ += val;
   if (start_ < 0)
     start_ = idx;
@@ -30,15 +44,12 @@ void Strip::add_value(int16_t idx, int16_t val)
     end_ = idx;
 }
 
-std::vector<int16_t>  Strip::as_vector() const
+std::map<uint16_t, int16_t> Strip::as_tree() const
 {
-  std::vector<int16_t> ret;
-  if (!data_.empty())
-  {
-    ret.resize(data_.rbegin()->first + 1);
-    for (auto d : data_)
-      ret[d.first] = d.second;
-  }
+  std::map<uint16_t, int16_t> ret;
+  for (size_t i = 0; i < data_.size(); ++i)
+    if (data_[i])
+      ret[i] = data_[i];
   return ret;
 }
 
@@ -69,113 +80,33 @@ Strip::Strip(const std::map<uint16_t, int16_t> &data)
 
 Strip Strip::suppress_negatives() const
 {
-  std::map<uint16_t, int16_t> data;
-  for (auto d : data_)
-    if (d.second > 0)
-      data[d.first] = d.second;
-  return Strip(data);
+  Strip ret;
+  for (size_t i = 0; i < data_.size(); ++i)
+    if (data_[i] > 0)
+      ret.add_value(i, data_[i]);
+  return ret;
 }
 
-Strip Strip::subset(std::string name, Settings params) const
+Strip Strip::subset(std::string name, const StripParams& params) const
 {
   if (name == "maxima")
-    return find_maxima(params.get_value("threshold"));
+    return subset<StripMaxima>(params);
   else if (name == "vmm")
-    return find_vmm_maxima(params.get_value("threshold"),
-                           params.get_value("over_threshold"));
+    return subset<StripVMM>(params);
   else if (name == "peak_separation")
-    return vmm_peak_separation(params.get_value("min_peak_separation"));
+    return subset<StripPeakSeparation>(params);
   else
     return *this;
 }
 
-Strip Strip::find_maxima(int16_t adc_threshold) const
-{
-  Strip maxima;
-  auto data = as_vector();
-  //at either end?
-  if ((data.size() > 1)
-      && (data[0] > data[1])
-      && (data[0] >= adc_threshold))
-    maxima.add_value(0, data[0]);
-  if ((data.size() > 1)
-      && (data[data.size()-1] > data[data.size()-2])
-      && (data[data.size()-1] >= adc_threshold))
-    maxima.add_value(data.size()-1, data[data.size()-1]);
-
-  //everywhere else
-  bool ascended = false;      //ascending move
-  for (uint16_t i = 0; i < (data.size() - 1); i++)
-  {
-    long firstDiff = data[i+ 1] - data[i];
-    if ( firstDiff > 0 ) { ascended  = true;  }
-    if ( firstDiff < 0 )
-    {
-      if (ascended && (data[i] >= adc_threshold))
-        maxima.add_value(i, data[i]);
-      ascended  = false;
-    }
-  }
-  return maxima;
-}
-
-Strip Strip::find_vmm_maxima(int16_t adc_threshold, int16_t over_threshold) const
-{
-  std::vector<uint16_t> start;
-  std::vector<uint16_t> end;
-  bool overthreshold {false};
-  auto data = as_vector();
-  for (uint16_t timebin=0; timebin < data.size(); ++timebin)
-  {
-    const auto &adc = data.at(timebin);
-    if (!overthreshold && (adc >= adc_threshold))
-    {
-      overthreshold = true;
-      start.push_back(timebin);
-    }
-
-    if (overthreshold && (adc < adc_threshold))
-    {
-      overthreshold = false;
-      end.push_back(timebin-1);
-    }
-  }
-
-  if (overthreshold)
-    end.push_back(data.size() - 1);
-
-  Strip vmm;
-  for (uint16_t i=0; i < start.size(); ++i)
-  {
-    if ((int(end.at(i)) - int(start.at(i)) + 1) < over_threshold)
-      continue;
-
-    uint16_t maxBin {start.at(i)};
-    int16_t maxADC {data.at(start.at(i))};
-    for (uint16_t timebin=start.at(i); timebin <= end.at(i); ++timebin)
-    {
-      const auto &adc = data.at(timebin);
-      if (adc >= maxADC)
-      {
-        maxADC = adc;
-        maxBin = timebin;
-      }
-    }
-    vmm.add_value(maxBin, maxADC);
-  }
-  return vmm;
-}
-
-Strip Strip::vmm_peak_separation(int16_t minimum_separation) const
+template<typename Stage>
+Strip Strip::subset(const StripParams& params) const
 {
   Strip ret;
-  int32_t prev_tb {-1};
-  for (auto i : data_)
+  Stage::apply(data_.data(), data_.size(), params, [&](size_t i, int16_t val)
   {
-    if ((prev_tb == -1) || ((i.first - prev_tb) > minimum_separation))
-      ret.add_value(i.first, i.second);
-    prev_tb = i.first;
-  }
+    ret.add_value(i, val);
+  });
   return ret;
 }
 
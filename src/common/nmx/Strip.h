@@ -8,6 +8,17 @@
 namespace NMX
 {
 
+//Strip::default_params() compiled for per-event use
+struct StripParams
+{
+  StripParams() {}
+  explicit StripParams(const Settings& settings);
+
+  int16_t threshold {150};
+  int16_t over_threshold {3};
+  int16_t min_peak_separation {0};
+};
+
 class Strip
 {
 public:
@@ -15,16 +26,19 @@ public:
   Strip(const std::vector<int16_t> &data);
   Strip(const std::map<uint16_t, int16_t> &data);
   Strip suppress_negatives() const;
-  Strip subset(std::string name, Settings params) const;
+  Strip subset(std::string name, const StripParams& params) const;
 
   static Settings default_params();
 
-  std::vector<int16_t>  as_vector() const;
-  std::map<uint16_t, int16_t> as_tree() const {return data_;}
+  std::vector<int16_t>  as_vector() const {return data_;}
+  std::map<uint16_t, int16_t> as_tree() const;
+
+  //samples by index from 0, zero where there is no value
+  const std::vector<int16_t>& dense() const {return data_;}
 
   //return values
-  inline bool empty() const {return data_.empty();}
-  inline int16_t num_valid() const {return data_.size();}
+  inline bool empty() const {return !num_valid_;}
+  inline int16_t num_valid() const {return num_valid_;}
   inline int16_t start() const {return start_;}
   inline int16_t end() const {return end_;}
   inline int64_t integral() const {return integral_;}
@@ -37,8 +51,8 @@ public:
   }
   inline int16_t value(int16_t idx) const
   {
-    if (data_.count(idx))
-      return data_.at(idx);
+    if ((idx >= 0) && (static_cast<size_t>(idx) < data_.size()))
+      return data_[idx];
     else
       return 0;
   }
@@ -46,16 +60,16 @@ public:
   std::string debug() const;
 
 private:
-  std::map<uint16_t, int16_t> data_;
+  std::vector<int16_t> data_;
+  size_t num_valid_  {0};
 
   int16_t start_     {-1};
   int16_t end_       {-1};
   int64_t integral_  {0};
 
   void add_value(int16_t idx, int16_t val);
-  Strip find_maxima(int16_t adc_threshold) const;
-  Strip find_vmm_maxima(int16_t adc_threshold, int16_t over_threshold) const;
-  Strip vmm_peak_separation(int16_t minimum_separation) const;
+  //samples kept by one of the stages in StripStages.h
+  template<typename Stage> Strip subset(const StripParams& params) const;
 };
 
 
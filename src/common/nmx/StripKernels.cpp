@@ -0,0 +1,143 @@
+#include "StripKernels.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace NMX {
+
+static inline void set_bits(std::vector<uint64_t>& bits, size_t i, uint64_t m)
+{
+  bits[i >> 6] |= m << (i & 63);
+}
+
+#if defined(__SSE2__)
+//one bit per 16-bit lane of a comparison result
+static inline uint32_t lane_bits(__m128i cmp)
+{
+  return _mm_movemask_epi8(_mm_packs_epi16(cmp, _mm_setzero_si128()));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline uint32_t lane_bits(__m256i cmp)
+{
+  return lane_bits(_mm256_castsi256_si128(cmp))
+      | (lane_bits(_mm256_extracti128_si256(cmp, 1)) << 8);
+}
+#endif
+
+void mask_at_least(const int16_t* data, size_t n, int16_t threshold,
+                   std::vector<uint64_t>& bits)
+{
+  bits.assign((n + 63) / 64, 0);
+  size_t i {0};
+
+#if defined(__AVX2__)
+  const __m256i thresh16 = _mm256_set1_epi16(threshold);
+  for (; i + 16 <= n; i += 16)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    set_bits(bits, i, ~lane_bits(_mm256_cmpgt_epi16(thresh16, v)) & 0xFFFF);
+  }
+#endif
+
+#if defined(__SSE2__)
+  const __m128i thresh8 = _mm_set1_epi16(threshold);
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    set_bits(bits, i, ~lane_bits(_mm_cmpgt_epi16(thresh8, v)) & 0xFF);
+  }
+#endif
+
+  for (; i < n; ++i)
+    if (data[i] >= threshold)
+      set_bits(bits, i, 1);
+}
+
+void mask_slopes(const int16_t* data, size_t n,
+                 std::vector<uint64_t>& rises,
+                 std::vector<uint64_t>& falls)
+{
+  rises.assign((n + 63) / 64, 0);
+  falls.assign((n + 63) / 64, 0);
+  size_t i {0};
+
+#if defined(__AVX2__)
+  for (; i + 17 <= n; i += 16)
+  {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+    set_bits(rises, i, lane_bits(_mm256_cmpgt_epi16(b, a)));
+    set_bits(falls, i, lane_bits(_mm256_cmpgt_epi16(a, b)));
+  }
+#endif
+
+#if defined(__SSE2__)
+  for (; i + 9 <= n; i += 8)
+  {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+    set_bits(rises, i, lane_bits(_mm_cmpgt_epi16(b, a)));
+    set_bits(falls, i, lane_bits(_mm_cmpgt_epi16(a, b)));
+  }
+#endif
+
+  for (; i + 1 < n; ++i)
+  {
+    if (data[i + 1] > data[i])
+      set_bits(rises, i, 1);
+    else if (data[i + 1] < data[i])
+      set_bits(falls, i, 1);
+  }
+}
+
+size_t next_bit(const std::vector<uint64_t>& bits, size_t n,
+                size_t from, bool set)
+{
+  while (from < n)
+  {
+    uint64_t word = bits[from >> 6];
+    if (!set)
+      word = ~word;
+    word >>= (from & 63);
+    if (word)
+      return std::min(n, from + count_trailing_zeros(word));
+    from = (from | 63) + 1;
+  }
+  return n;
+}
+
+size_t last_argmax(const int16_t* data, size_t start, size_t end)
+{
+  int16_t best = data[start];
+  size_t i = start;
+
+#if defined(__SSE2__)
+  if ((end - start) >= 16)
+  {
+    __m128i maxima = _mm_set1_epi16(best);
+    for (; i + 8 <= end + 1; i += 8)
+      maxima = _mm_max_epi16(maxima,
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    int16_t lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), maxima);
+    for (auto l : lanes)
+      best = std::max(best, l);
+  }
+#endif
+
+  for (; i <= end; ++i)
+    best = std::max(best, data[i]);
+
+  size_t ret = end;
+  while (data[ret] != best)
+    --ret;
+  return ret;
+}
+
+}
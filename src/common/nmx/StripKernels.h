@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace NMX
+{
+
+// Scanning kernels over dense strip samples. Bit masks hold one bit per
+// sample, least significant bit first, in 64-bit words. Vectorized with
+// AVX2 or SSE2 where the compiler targets them, scalar otherwise.
+
+// bit i set where data[i] >= threshold, for i < n
+void mask_at_least(const int16_t* data, size_t n, int16_t threshold,
+                   std::vector<uint64_t>& bits);
+
+// bit i set in rises where data[i+1] > data[i], in falls where
+// data[i+1] < data[i], for i < n-1
+void mask_slopes(const int16_t* data, size_t n,
+                 std::vector<uint64_t>& rises,
+                 std::vector<uint64_t>& falls);
+
+// index of the next bit at or after from that equals set, n if none
+size_t next_bit(const std::vector<uint64_t>& bits, size_t n,
+                size_t from, bool set);
+
+// index of the last maximum in data[start..end]
+size_t last_argmax(const int16_t* data, size_t start, size_t end);
+
+// index of the lowest set bit, w must not be 0
+inline size_t count_trailing_zeros(uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(w);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long ret;
+  _BitScanForward64(&ret, w);
+  return ret;
+#else
+  size_t ret {0};
+  while (!(w & 1))
+  {
+    w >>= 1;
+    ++ret;
+  }
+  return ret;
+#endif
+}
+
+}
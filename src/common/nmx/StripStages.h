@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Strip.h"
+#include "StripKernels.h"
+
+namespace NMX
+{
+
+// Statically typed strip subsets, for pipelines fixed at compile time.
+// apply() scans n dense samples and passes each kept sample to
+// out(index, value); values may be zero and should then be ignored.
+
+// every valid sample, in increasing index order
+struct StripAll
+{
+  template<typename Out>
+  static void apply(const int16_t* data, size_t n,
+                    const StripParams&, Out out)
+  {
+    for (size_t i = 0; i < n; ++i)
+      if (data[i])
+        out(i, data[i]);
+  }
+};
+
+// local maxima at or above threshold, those at either end first
+struct StripMaxima
+{
+  template<typename Out>
+  static void apply(const int16_t* data, size_t n,
+                    const StripParams& params, Out out)
+  {
+    if (n < 2)
+      return;
+
+    //at either end?
+    if ((data[0] > data[1]) && (data[0] >= params.threshold))
+      out(0, data[0]);
+    if ((data[n-1] > data[n-2]) && (data[n-1] >= params.threshold))
+      out(n - 1, data[n-1]);
+
+    //everywhere else, visiting only bins where the slope changes
+    std::vector<uint64_t> rises, falls;
+    mask_slopes(data, n, rises, falls);
+    for (size_t w = 0; w < rises.size(); ++w)
+      rises[w] |= falls[w];
+
+    bool ascended = false;      //ascending move
+    for (size_t i = next_bit(rises, n - 1, 0, true); i < (n - 1);
+         i = next_bit(rises, n - 1, i + 1, true))
+    {
+      if (data[i + 1] > data[i])
+        ascended = true;
+      else
+      {
+        if (ascended && (data[i] >= params.threshold))
+          out(i, data[i]);
+        ascended = false;
+      }
+    }
+  }
+};
+
+// last maximum of each run of at least over_threshold samples at or
+// above threshold, in increasing index order
+struct StripVMM
+{
+  template<typename Out>
+  static void apply(const int16_t* data, size_t n,
+                    const StripParams& params, Out out)
+  {
+    std::vector<uint64_t> over;
+    mask_at_least(data, n, params.threshold, over);
+
+    for (size_t start = next_bit(over, n, 0, true); start < n;
+         start = next_bit(over, n, start, true))
+    {
+      size_t end = next_bit(over, n, start, false) - 1;
+      if ((int(end) - int(start) + 1) >= params.over_threshold)
+      {
+        size_t max_bin = last_argmax(data, start, end);
+        out(max_bin, data[max_bin]);
+      }
+      start = end + 1;
+    }
+  }
+};
+
+// output of Stage without peaks closer than min_peak_separation to the
+// previous one; Stage must produce samples in increasing index order
+template<typename Stage>
+struct Separated
+{
+  template<typename Out>
+  static void apply(const int16_t* data, size_t n,
+                    const StripParams& params, Out out)
+  {
+    int32_t previous {-1};
+    Stage::apply(data, n, params, [&](size_t i, int16_t val)
+    {
+      if (!val)
+        return;
+      if ((previous == -1) ||
+          ((int32_t(i) - previous) > params.min_peak_separation))
+        out(i, val);
+      previous = i;
+    });
+  }
+};
+
+using StripPeakSeparation = Separated<StripAll>;
+
+}
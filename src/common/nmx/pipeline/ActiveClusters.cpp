@@ -0,0 +1,209 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include <ActiveClusters.h>
+#include <algorithm>
+#include <limits>
+
+namespace NMX {
+
+constexpr size_t ActiveClusters::bucket_strips;
+
+ActiveClusters::ActiveClusters(MicroclusterPool &pool,
+                               uint16_t time_slack, uint16_t strip_slack)
+  : pool_(pool)
+  , time_slack_(time_slack)
+  , strip_slack_(strip_slack)
+{}
+
+bool ActiveClusters::join(const Eventlet &eventlet)
+{
+  expire(eventlet.time);
+
+  size_t bucket = eventlet.strip / bucket_strips;
+  if (bucket >= buckets_.size())
+    return false;
+
+  //clusters are visited in order of creation up to the first expired one
+  uint64_t limit = first_expired();
+
+  candidates_.clear();
+  for (auto id : buckets_[bucket])
+  {
+    if (id >= limit)
+      continue;
+    const auto &cluster = entry(id).cluster;
+    if (cluster.time_adjacent(eventlet.time) &&
+        cluster.strip_adjacent(eventlet.strip))
+      candidates_.push_back(id);
+  }
+  if (candidates_.empty())
+    return false;
+  std::sort(candidates_.begin(), candidates_.end());
+
+  uint64_t id = candidates_.front();
+  auto &target = entry(id);
+  uint64_t time_end = target.cluster.time_end;
+  target.cluster.insert(eventlet);
+  for (size_t i = 1; i < candidates_.size(); ++i)
+  {
+    auto &other = entry(candidates_[i]);
+    target.cluster.merge(other.cluster);
+    unindex(candidates_[i], other);
+    other.open = false;
+    open_count_--;
+  }
+  update(id, target, time_end);
+  return true;
+}
+
+void ActiveClusters::open(const Eventlet &eventlet)
+{
+  uint64_t id = next_id();
+  entries_.push_back(Entry(MacroCluster(pool_, time_slack_, strip_slack_)));
+  entries_.back().cluster.insert(eventlet);
+  open_count_++;
+  index(id, entries_.back());
+  by_end_.push_back(std::make_pair(eventlet.time, id));
+}
+
+bool ActiveClusters::retire(uint64_t time, Retired &retired)
+{
+  expire(time);
+  bool ret {false};
+  while (!entries_.empty())
+  {
+    auto &front = entries_.front();
+    if (front.open)
+    {
+      if (front.cluster.time_adjacent(time))
+        break;
+      unindex(base_id_, front);
+      uint64_t start = front.cluster.time_start;
+      retired.insert(std::make_pair(start, std::move(front.cluster)));
+      open_count_--;
+      ret = true;
+    }
+    entries_.pop_front();
+    base_id_++;
+  }
+  return ret;
+}
+
+void ActiveClusters::retire_all(Retired &retired)
+{
+  for (auto &e : entries_)
+    if (e.open)
+    {
+      uint64_t start = e.cluster.time_start;
+      retired.insert(std::make_pair(start, std::move(e.cluster)));
+    }
+  clear();
+}
+
+uint64_t ActiveClusters::time_start() const
+{
+  //clusters are opened in chronological order and merged into the earliest
+  for (const auto &e : entries_)
+    if (e.open)
+      return e.cluster.time_start;
+  return std::numeric_limits<uint64_t>::max();
+}
+
+bool ActiveClusters::empty() const
+{
+  return !open_count_;
+}
+
+size_t ActiveClusters::size() const
+{
+  return open_count_;
+}
+
+void ActiveClusters::clear()
+{
+  base_id_ = next_id();
+  entries_.clear();
+  open_count_ = 0;
+  by_end_.clear();
+  expired_ = decltype(expired_)();
+  buckets_.clear();
+}
+
+uint64_t ActiveClusters::next_id() const
+{
+  return base_id_ + entries_.size();
+}
+
+ActiveClusters::Entry &ActiveClusters::entry(uint64_t id)
+{
+  return entries_[id - base_id_];
+}
+
+uint64_t ActiveClusters::first_expired()
+{
+  while (!expired_.empty() && (expired_.top() < base_id_))
+    expired_.pop();
+  return expired_.empty() ? next_id() : expired_.top();
+}
+
+void ActiveClusters::expire(uint64_t time)
+{
+  while (!by_end_.empty() && ((by_end_.front().first + time_slack_) < time))
+  {
+    uint64_t time_end = by_end_.front().first;
+    uint64_t id = by_end_.front().second;
+    by_end_.pop_front();
+    if (id < base_id_)
+      continue;
+    auto &e = entry(id);
+    if (!e.open || e.expired || (e.cluster.time_end != time_end))
+      continue;
+    unindex(id, e);
+    e.expired = true;
+    expired_.push(id);
+  }
+}
+
+void ActiveClusters::index(uint64_t id, Entry &entry)
+{
+  const auto &cluster = entry.cluster;
+  int lowest = std::max(int(cluster.strip_start) - int(strip_slack_), 0);
+  entry.bucket_start = lowest / bucket_strips;
+  entry.bucket_end = (cluster.strip_end + strip_slack_) / bucket_strips;
+  if (entry.bucket_end >= buckets_.size())
+    buckets_.resize(entry.bucket_end + 1);
+  for (size_t b = entry.bucket_start; b <= entry.bucket_end; ++b)
+    buckets_[b].push_back(id);
+}
+
+void ActiveClusters::unindex(uint64_t id, Entry &entry)
+{
+  if (entry.expired)
+    return;
+
+  for (size_t b = entry.bucket_start; b <= entry.bucket_end; ++b)
+  {
+    auto &bucket = buckets_[b];
+    auto it = std::find(bucket.begin(), bucket.end(), id);
+    *it = bucket.back();
+    bucket.pop_back();
+  }
+}
+
+void ActiveClusters::update(uint64_t id, Entry &entry, uint64_t time_end)
+{
+  const auto &cluster = entry.cluster;
+  if (cluster.time_end != time_end)
+    by_end_.push_back(std::make_pair(cluster.time_end, id));
+
+  int lowest = std::max(int(cluster.strip_start) - int(strip_slack_), 0);
+  size_t bucket_start = lowest / bucket_strips;
+  size_t bucket_end = (cluster.strip_end + strip_slack_) / bucket_strips;
+  if ((bucket_start != entry.bucket_start) || (bucket_end != entry.bucket_end))
+  {
+    unindex(id, entry);
+    index(id, entry);
+  }
+}
+
+}
@@ -0,0 +1,107 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Open clusters of one plane, indexed for eventlet lookup
+ */
+
+#pragma once
+
+#include <Cluster.h>
+#include <deque>
+#include <map>
+#include <queue>
+#include <vector>
+
+namespace NMX {
+
+/** @brief open MacroClusters of one plane in order of creation, indexed by
+ *  strip range and by time_end so that joining eventlets and retiring
+ *  clusters do not scan every open cluster
+ *  Eventlets MUST BE IN CHRONOLOGICAL ORDER, clusters are then never
+ *  reordered by their start time.
+ */
+class ActiveClusters
+{
+public:
+  //by time_start, in order of retirement for equal times
+  using Retired = std::multimap<uint64_t, MacroCluster>;
+
+  /** @brief eventlets of clusters are stored in pool, which must outlive
+   *  them
+   */
+  ActiveClusters(MicroclusterPool &pool, uint16_t time_slack, uint16_t strip_slack);
+
+  /** @brief adds eventlet to the first adjacent cluster, merging any other
+   *  adjacent ones into it; clusters after the first time-expired one
+   *  are not considered
+   * @returns false if no cluster was adjacent
+   */
+  bool join(const Eventlet &eventlet);
+
+  /** @brief starts a new cluster with eventlet
+   */
+  void open(const Eventlet &eventlet);
+
+  /** @brief moves clusters that are no longer time adjacent to time
+   *  into retired, oldest first, up to the first that still is
+   * @returns true if any were retired
+   */
+  bool retire(uint64_t time, Retired &retired);
+
+  /** @brief moves all clusters into retired
+   */
+  void retire_all(Retired &retired);
+
+  /** @brief earliest time_start of open clusters, max if there are none
+   */
+  uint64_t time_start() const;
+
+  bool empty() const;
+  size_t size() const;
+  void clear();
+
+private:
+  MicroclusterPool &pool_;
+  uint16_t time_slack_ {28};
+  uint16_t strip_slack_ {18};
+
+  struct Entry
+  {
+    explicit Entry(MacroCluster &&c) : cluster(std::move(c)) {}
+
+    MacroCluster cluster;
+    bool open {true};       //false once merged into another cluster
+    bool expired {false};
+    size_t bucket_start {0};
+    size_t bucket_end {0};
+  };
+
+  //by order of creation, entries_[0] has id base_id_
+  std::deque<Entry> entries_;
+  uint64_t base_id_ {0};
+  size_t open_count_ {0};
+
+  //(time_end, id) as clusters were extended, in increasing time_end for
+  //chronological eventlets; stale once a cluster has a later time_end
+  std::deque<std::pair<uint64_t, uint64_t>> by_end_;
+  //ids of clusters past time_slack_, smallest first; those below
+  //base_id_ have since been retired
+  std::priority_queue<uint64_t, std::vector<uint64_t>,
+                      std::greater<uint64_t>> expired_;
+  //ids of clusters that may be strip adjacent to strips in each bucket
+  std::vector<std::vector<uint64_t>> buckets_;
+  std::vector<uint64_t> candidates_;
+
+  static constexpr size_t bucket_strips {32};
+
+  uint64_t next_id() const;
+  Entry &entry(uint64_t id);
+  uint64_t first_expired();
+  void expire(uint64_t time);
+  void index(uint64_t id, Entry &entry);
+  void unindex(uint64_t id, Entry &entry);
+  void update(uint64_t id, Entry &entry, uint64_t time_end);
+};
+
+}
@@ -1,42 +1,164 @@
 /** Copyright (C) 2016, 2017 European Spallation Source ERIC */
 
 #include <ChronoQ.h>
+#include "StripKernels.h"
+#include <algorithm>
 
 namespace NMX {
 
+//ring covers this many latencies, in at most max_buckets buckets
+static constexpr uint64_t ring_latencies {4};
+static constexpr uint64_t max_buckets {1 << 14};
+
 ChronoQ::ChronoQ(uint64_t latency)
   : latency_(latency)
-{}
+{
+  uint64_t window = std::max(ring_latencies * latency, uint64_t(64));
+  while ((window >> shift_) > max_buckets)
+    shift_++;
+  size_t count = 64;
+  while (count < (window >> shift_))
+    count <<= 1;
+  buckets_.resize(count);
+  occupied_.resize(count / 64, 0);
+}
 
 void ChronoQ::push(const EventletPacket &e)
 {
   current_latest_ = std::max(current_latest_, e.time_start);
 
-  for (auto eventlet : e.eventlets)
-    backlog_.insert(eventlet);
+  for (const auto& eventlet : e.eventlets)
+    insert(eventlet);
+  settle();
 }
 
 size_t ChronoQ::size() const
 {
-  return backlog_.size();
+  return count_ + overflow_.size();
 }
 
 bool ChronoQ::empty() const
 {
-  return backlog_.empty();
+  return !size();
 }
 
 bool ChronoQ::ready() const
 {
-  return (backlog_.size() &&
-          ((backlog_.begin()->time - current_latest_) > latency_));
+  //settled, so only empty if overflow is too
+  if (!count_)
+    return false;
+  const auto& first = buckets_[slot(front_)][front_popped_];
+  return ((first.time - current_latest_) > latency_);
 }
 
 Eventlet ChronoQ::pop()
 {
-  auto ret = *backlog_.begin();
-  backlog_.erase(backlog_.begin());
+  auto ret = buckets_[slot(front_)][front_popped_];
+  front_popped_++;
+  count_--;
+  settle();
+  return ret;
+}
+
+size_t ChronoQ::pop(EventletPacket& packet)
+{
+  size_t ret {0};
+  while (ready())
+  {
+    packet.add(pop());
+    ret++;
+  }
   return ret;
 }
 
+size_t ChronoQ::slot(uint64_t bucket) const
+{
+  return bucket & (buckets_.size() - 1);
+}
+
+void ChronoQ::insert(const Eventlet& e)
+{
+  uint64_t bucket = e.time >> shift_;
+  if (!count_)
+  {
+    //restart ring at this or the earliest waiting eventlet
+    buckets_[slot(front_)].clear();
+    front_popped_ = 0;
+    front_ = bucket;
+    if (!overflow_.empty())
+      front_ = std::min(front_, overflow_.begin()->time >> shift_);
+    migrate();
+  }
+
+  if (bucket >= (front_ + buckets_.size()))
+    overflow_.insert(e);
+  else
+    store(e, std::max(bucket, front_));
+}
+
+void ChronoQ::store(const Eventlet& e, uint64_t bucket)
+{
+  size_t s = slot(bucket);
+  buckets_[s].push_back(e);
+  occupied_[s / 64] |= (uint64_t(1) << (s % 64));
+  if (bucket == front_)
+    front_sorted_ = false;
+  count_++;
+}
+
+void ChronoQ::migrate()
+{
+  while (!overflow_.empty() &&
+         ((overflow_.begin()->time >> shift_) < (front_ + buckets_.size())))
+  {
+    store(*overflow_.begin(), overflow_.begin()->time >> shift_);
+    overflow_.erase(overflow_.begin());
+  }
+}
+
+void ChronoQ::settle()
+{
+  while (true)
+  {
+    if (!count_)
+    {
+      if (overflow_.empty())
+        return;
+      buckets_[slot(front_)].clear();
+      front_popped_ = 0;
+      front_ = overflow_.begin()->time >> shift_;
+      migrate();
+    }
+
+    size_t s = slot(front_);
+    auto& bucket = buckets_[s];
+    if (front_popped_ < bucket.size())
+    {
+      if (!front_sorted_)
+        std::stable_sort(bucket.begin() + front_popped_, bucket.end(),
+                         Eventlet::CompareTimeStrip());
+      front_sorted_ = true;
+      return;
+    }
+
+    //front bucket done, move on to next nonempty one
+    bucket.clear();
+    front_popped_ = 0;
+    occupied_[s / 64] &= ~(uint64_t(1) << (s % 64));
+
+    size_t next = s;
+    size_t word = s / 64;
+    uint64_t bits = occupied_[word] & ~((uint64_t(2) << (s % 64)) - 1);
+    while (!bits)
+    {
+      word = (word + 1) % occupied_.size();
+      bits = occupied_[word];
+    }
+    next = word * 64 + count_trailing_zeros(bits);
+    front_ += (next + buckets_.size() - s) % buckets_.size();
+    front_sorted_ = false;
+    migrate();
+  }
+}
+
 }
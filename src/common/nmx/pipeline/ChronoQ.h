@@ -9,9 +9,15 @@
 
 #include <EventletPacket.h>
 #include <set>
+#include <vector>
 
 namespace NMX {
 
+/** @brief eventlets in order of time, then strip, then arrival.
+ *  Eventlets within a few latencies of the earliest are kept in a ring
+ *  of time buckets, each sorted by strip once it comes up for popping;
+ *  later ones wait in an overflow set until the ring reaches them.
+ */
 class ChronoQ
 {
 public:
@@ -23,11 +29,36 @@ public:
   size_t size() const;
   Eventlet pop();
 
-private:
-  std::multiset<Eventlet, Eventlet::CompareTimeStrip> backlog_;
+  /** @brief appends all ready eventlets to packet, in order of pop()
+   * @returns number of eventlets appended
+   */
+  size_t pop(EventletPacket& packet);
 
+private:
   uint64_t latency_;
   uint64_t current_latest_{0};
+
+  //bucket number of an eventlet is time >> shift_
+  size_t shift_ {0};
+  //ring of buckets front_, front_ + 1, ... at slot bucket & (size - 1)
+  std::vector<std::vector<Eventlet>> buckets_;
+  //bit per nonempty slot
+  std::vector<uint64_t> occupied_;
+  uint64_t front_ {0};
+  //eventlets of front bucket already popped
+  size_t front_popped_ {0};
+  bool front_sorted_ {true};
+  //eventlets in ring, not yet popped
+  size_t count_ {0};
+
+  //beyond the ring
+  std::multiset<Eventlet, Eventlet::CompareTimeStrip> overflow_;
+
+  size_t slot(uint64_t bucket) const;
+  void insert(const Eventlet& e);
+  void store(const Eventlet& e, uint64_t bucket);
+  void migrate();
+  void settle();
 };
 
 }
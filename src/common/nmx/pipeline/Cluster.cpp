@@ -3,6 +3,7 @@
 #include <Cluster.h>
 
 #include <sstream>
+#include <algorithm>
 
 namespace NMX {
 
@@ -14,11 +15,64 @@ uint64_t sat_subu64(uint64_t x, uint64_t y)
   return res;
 }
 
+constexpr size_t MacroCluster::no_storage;
+
 MacroCluster::MacroCluster(uint16_t time_slack, uint16_t strip_slack)
   : time_slack_(time_slack)
   , strip_slack_(strip_slack)
 {}
 
+MacroCluster::MacroCluster(MicroclusterPool &pool,
+                           uint16_t time_slack, uint16_t strip_slack)
+  : time_slack_(time_slack)
+  , strip_slack_(strip_slack)
+  , pool_(&pool)
+{}
+
+MacroCluster::~MacroCluster()
+{
+  release();
+}
+
+MacroCluster::MacroCluster(MacroCluster &&o)
+  : time_start(o.time_start)
+  , time_end(o.time_end)
+  , strip_start(o.strip_start)
+  , strip_end(o.strip_end)
+  , planes(o.planes)
+  , time_slack_(o.time_slack_)
+  , strip_slack_(o.strip_slack_)
+  , pool_(o.pool_)
+  , storage_(o.storage_)
+{
+  o.storage_ = no_storage;
+}
+
+MacroCluster &MacroCluster::operator=(MacroCluster &&o)
+{
+  if (this == &o)
+    return *this;
+  release();
+  time_start = o.time_start;
+  time_end = o.time_end;
+  strip_start = o.strip_start;
+  strip_end = o.strip_end;
+  planes = o.planes;
+  time_slack_ = o.time_slack_;
+  strip_slack_ = o.strip_slack_;
+  pool_ = o.pool_;
+  storage_ = o.storage_;
+  o.storage_ = no_storage;
+  return *this;
+}
+
+void MacroCluster::release()
+{
+  if (storage_ == no_storage)
+    return;
+  pool_->release(storage_);
+  storage_ = no_storage;
+}
 
 bool MacroCluster::time_adjacent(uint64_t time) const
 {
@@ -56,51 +110,97 @@ void MacroCluster::insert(const Eventlet &eventlet)
 {
   if (!eventlet.adc)
     return;
-  if (contents.empty())
+  if (storage_ == no_storage)
   {
+    storage_ = pool_->requisition_or_grow();
     time_start = time_end = eventlet.time;
     strip_start = strip_end = eventlet.strip;
   }
-  contents.push_back(eventlet);
+  auto &contents = (*pool_)[storage_];
+  contents.current() = eventlet;
+  ++contents;
   time_start = std::min(time_start, eventlet.time);
   time_end = std::max(time_end, eventlet.time);
   strip_start = std::min(strip_start, eventlet.strip);
   strip_end = std::max(strip_end, eventlet.strip);
-  planes.insert(eventlet.plane);
+  planes |= (1 << eventlet.plane);
 }
 
 void MacroCluster::merge(MacroCluster &o)
 {
-  contents.splice(contents.end(), o.contents);
-  time_start = std::min(time_start, o.time_start);
-  time_end = std::max(time_end, o.time_end);
-  strip_start = std::min(strip_start, o.strip_start);
-  strip_end = std::max(strip_end, o.strip_end);
-  planes.insert(o.planes.begin(), o.planes.end());
+  if (o.storage_ != no_storage)
+  {
+    if (storage_ == no_storage)
+      std::swap(storage_, o.storage_);
+    else
+    {
+      auto &contents = (*pool_)[storage_];
+      const auto &other = (*pool_)[o.storage_];
+      for (size_t i = 0; i < other.size(); ++i)
+      {
+        contents.current() = other[i];
+        ++contents;
+      }
+      o.release();
+    }
+  }
+  extend(o);
 }
 
-void MacroCluster::merge_copy(const MacroCluster &o)
+void MacroCluster::extend(const MacroCluster &o)
 {
-  contents.insert(contents.end(), o.contents.begin(), o.contents.end());
   time_start = std::min(time_start, o.time_start);
   time_end = std::max(time_end, o.time_end);
   strip_start = std::min(strip_start, o.strip_start);
   strip_end = std::max(strip_end, o.strip_end);
-  planes.insert(o.planes.begin(), o.planes.end());
+  planes |= o.planes;
+}
+
+MacroCluster MacroCluster::bounds() const
+{
+  MacroCluster ret(time_slack_, strip_slack_);
+  ret.time_start = time_start;
+  ret.time_end = time_end;
+  ret.strip_start = strip_start;
+  ret.strip_end = strip_end;
+  ret.planes = planes;
+  return ret;
+}
+
+size_t MacroCluster::size() const
+{
+  if (storage_ == no_storage)
+    return 0;
+  return (*pool_)[storage_].size();
+}
+
+bool MacroCluster::empty() const
+{
+  return !size();
+}
+
+const Eventlet &MacroCluster::operator[](size_t i) const
+{
+  return (*static_cast<const MicroclusterPool*>(pool_))[storage_][i];
+}
+
+bool MacroCluster::has_plane(uint16_t plane) const
+{
+  return planes & (1 << plane);
 }
 
 std::string MacroCluster::debug() const
 {
   std::stringstream ss;
-  if (planes.count(0) && planes.count(1))
+  if (has_plane(0) && has_plane(1))
     ss << " XY ";
-  else if (planes.count(0))
+  else if (has_plane(0))
     ss << " X  ";
-  else if (planes.count(1))
+  else if (has_plane(1))
     ss << " Y ";
   ss << "t[" << time_start << "," << time_end << "] ";
   ss << "s[" << strip_start << "," << strip_end << "] ";
-  ss << "   evts=" << contents.size();
+  ss << "   evts=" << size();
   return ss.str();
 }
 
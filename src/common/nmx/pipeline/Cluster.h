@@ -7,17 +7,27 @@
 
 #pragma once
 
-#include <Eventlet.h>
-#include <list>
-#include <set>
+#include <MicroclusterPool.h>
+#include <string>
 
 namespace NMX {
 
 uint64_t sat_subu64(uint64_t x, uint64_t y);
 
+/** @brief bounds of adjacent eventlets, which are stored in a pooled
+ *  Microcluster while the MacroCluster owns one. Move-only, so clusters
+ *  are handed between stages without copying their eventlets.
+ */
 struct MacroCluster
 {
   MacroCluster(uint16_t time_slack, uint16_t strip_slack);
+  MacroCluster(MicroclusterPool &pool, uint16_t time_slack, uint16_t strip_slack);
+  ~MacroCluster();
+
+  MacroCluster(MacroCluster &&o);
+  MacroCluster &operator=(MacroCluster &&o);
+  MacroCluster(const MacroCluster &) = delete;
+  MacroCluster &operator=(const MacroCluster &) = delete;
 
   bool time_adjacent(uint64_t time) const;
   bool time_adjacent(const MacroCluster &e) const;
@@ -29,18 +39,33 @@ struct MacroCluster
   bool belongs(const Eventlet &eventlet) const;
 
   void insert(const Eventlet &eventlet);
+
+  /** @brief takes over the eventlets of o, releasing its storage
+   */
   void merge(MacroCluster &o);
-  void merge_copy(const MacroCluster &o);
+
+  /** @brief extends bounds and planes to cover o, without its eventlets
+   */
+  void extend(const MacroCluster &o);
+
+  /** @brief copy of bounds and planes, without eventlets
+   */
+  MacroCluster bounds() const;
+
+  size_t size() const;
+  bool empty() const;
+  const Eventlet &operator[](size_t i) const;
+
+  bool has_plane(uint16_t plane) const;
 
   std::string debug() const;
 
-  std::list<Eventlet> contents;
   uint64_t time_start{0}; // start of event timestamp
   uint64_t time_end{0};   // end of event timestamp
   uint16_t strip_start{0}; // start of event position
   uint16_t strip_end{0};   // end of event position
 
-  std::set<uint16_t> planes;
+  uint8_t planes{0};       // bit per plane
 
   uint16_t time_slack_ {28};
   uint16_t strip_slack_ {15};
@@ -49,6 +74,15 @@ struct MacroCluster
   {
     bool operator()(const MacroCluster &a, const MacroCluster &b);
   };
+
+private:
+  static constexpr size_t no_storage {static_cast<size_t>(-1)};
+
+  MicroclusterPool *pool_ {nullptr};
+  size_t storage_ {no_storage};
+
+  void release();
 };
 
 }
+
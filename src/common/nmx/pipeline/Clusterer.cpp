@@ -6,82 +6,44 @@
 #include "CustomLogger.h"
 //#include <sstream>
 #include <algorithm>
+#include <iterator>
+#include <limits>
 
 namespace NMX {
 
-Clusterer::Clusterer(uint16_t time_slack, uint16_t strip_slack, uint16_t cor_time_slack)
+Clusterer::Clusterer(uint16_t time_slack, uint16_t strip_slack, uint16_t cor_time_slack,
+                     size_t correlation_bound)
   : time_slack_(time_slack)
   , strip_slack_(strip_slack)
   , correlation_time_slack_(cor_time_slack)
+  , correlation_bound_(correlation_bound)
+  , pool_(64, Microcluster(16))
+  , clusters_x_(pool_, time_slack, strip_slack)
+  , clusters_y_(pool_, time_slack, strip_slack)
 {}
 
 void Clusterer::insert(const Eventlet &eventlet) {
   if (!eventlet.adc)
     return;
   
-  std::list<MacroCluster>& clusters = eventlet.plane ? clusters_y_ : clusters_x_;
-
-  std::list<MacroCluster>::iterator it, itt;
-  it = clusters.begin();
-  int matches = 0;
-  //  DBG << "Adding ===================== " << eventlet.debug() << "\n";
-  while (it != clusters.end())
+  ActiveClusters& clusters = eventlet.plane ? clusters_y_ : clusters_x_;
+  if (clusters.join(eventlet))
   {
-    if (it->time_adjacent(eventlet.time))
-    {
-      if (it->strip_adjacent(eventlet.strip))
-      {
-        if (matches)
-        {
-          itt->merge(*it);
-          clusters.erase(it++);
-        }
-        else
-        {
-          it->insert(eventlet);
-          itt = it;
-          it++;
-        }
-        matches++;
-      }
-      else
-        it++;
-    }
-    else if (eventlet.time >= (it->time_end + time_slack_))
-      break;
-    else
-      it++;
+    if (!forced_.empty())
+      resume(correlation_bound_);
+    return;
   }
 
-  if (matches > 1)
-    clusters.sort(MacroCluster::CompareStartTime());
-
-  if (!matches)
-  {
-    clusters.push_back(MacroCluster(time_slack_, strip_slack_));
-    clusters.back().insert(eventlet);
-    //    DBG << "Made new cluster " << clusters.back().debug() << "\n";
-    bool done_with_some {false};
-
-    for (auto it = clusters_x_.begin();
-         it != clusters_x_.end() && !it->time_adjacent(eventlet.time);)
-    {
-      clustered_.insert(*it);
-      clusters_x_.erase(it++);
-      done_with_some = true;
-    }
+  clusters.open(eventlet);
 
-    for (auto it = clusters_y_.begin();
-         it != clusters_y_.end() && !it->time_adjacent(eventlet.time);)
-    {
-      clustered_.insert(*it);
-      clusters_y_.erase(it++);
-      done_with_some = true;
-    }
+  bool done_with_some = clusters_x_.retire(eventlet.time, clustered_);
+  if (clusters_y_.retire(eventlet.time, clustered_))
+    done_with_some = true;
 
-    if (done_with_some && !clustered_.empty())
-      correlate(eventlet.time);
-  }
+  if (done_with_some && !clustered_.empty())
+    correlate(eventlet.time);
+  else if (!forced_.empty())
+    resume(correlation_bound_);
 }
 
 
@@ -91,101 +53,118 @@ bool Clusterer::events_ready() const {
 
 bool Clusterer::empty() const {
   return ready_events_.empty() &&
+      forced_.empty() &&
+      clustered_.empty() &&
       clusters_x_.empty() &&
       clusters_y_.empty();
 }
 
 std::list<SimpleEvent> Clusterer::pop_events()
 {
-  auto ret = ready_events_;
-  ready_events_.clear();
+  std::list<SimpleEvent> ret;
+  ret.swap(ready_events_);
   return ret;
 }
 
 void Clusterer::dump()
 {
-  for (auto c : clusters_x_)
-    clustered_.insert(c);
-  for (auto c : clusters_y_)
-    clustered_.insert(c);
-  clusters_x_.clear();
-  clusters_y_.clear();
-  correlate(true);
+  clusters_x_.retire_all(clustered_);
+  clusters_y_.retire_all(clustered_);
+  forced_.push_back(std::move(clustered_));
+  clustered_.clear();
+  resume(0);
 }
 
 void Clusterer::clear()
 {
   ready_events_.clear();
+  forced_.clear();
+  clustered_.clear();
   clusters_x_.clear();
   clusters_y_.clear();
 }
 
 void Clusterer::correlate(bool force)
 {
-  //  DBG << "Correlating " << clustered_.size() << "\n";
+  //a forced correlation takes the clusters retired so far on their own,
+  //even if the bound defers it past later retirements
+  if (force)
+  {
+    forced_.push_back(std::move(clustered_));
+    clustered_.clear();
+  }
 
-  std::multiset<MacroCluster, MacroCluster::CompareStartTime> leftovers;
-  std::list<MacroCluster> x, y;
+  if (resume(correlation_bound_) && !force)
+    sweep(clustered_, false);
+}
 
-  MacroCluster supercluster(correlation_time_slack_, strip_slack_);
-  auto it = clustered_.begin();
-  if (it != clustered_.end())
+bool Clusterer::resume(size_t bound)
+{
+  budget_ = bound ? bound : std::numeric_limits<size_t>::max();
+  while (!forced_.empty())
   {
-    if (it->planes.count(1))
-      y.push_back(*it);
-    else
-      x.push_back(*it);
-    supercluster = *it;
-    it++;
-    //    DBG << "Initial supercluster " << supercluster.debug() << "\n";
+    if (!sweep(forced_.front(), true))
+      return false;
+    forced_.pop_front();
   }
-  while (it != clustered_.end())
+  return true;
+}
+
+bool Clusterer::sweep(ActiveClusters::Retired &clusters, bool force)
+{
+  //  DBG << "Correlating " << clusters.size() << "\n";
+
+  while (budget_)
   {
-    //    DBG << "Comparing to " << it->debug() << "\n";
-    if (supercluster.time_overlap(*it))
+    //clusters overlapping in time with the first one, in order of start time
+    supercluster_.clear();
+    auto leftover = clusters.end();
+    MacroCluster supercluster(correlation_time_slack_, strip_slack_);
+    auto it = clusters.begin();
+    for (; it != clusters.end(); ++it)
     {
-      if (it->planes.count(1))
-        y.push_back(*it);
+      //    DBG << "Comparing to " << it->second.debug() << "\n";
+      if (supercluster_.empty())
+        supercluster = it->second.bounds();
+      else if (!supercluster.time_adjacent(it->first))
+        break; //this and all later ones start too late to overlap
+      else if (supercluster.time_overlap(it->second))
+        supercluster.extend(it->second);
       else
-        x.push_back(*it);
-      //      DBG << "  merge to supercluster";
-      supercluster.merge_copy(*it);
-    }
-    else
-    {
-      //      DBG << "  leftover";
-      leftovers.insert(*it);
+      {
+        leftover = it;
+        continue;
+      }
+      supercluster_.push_back(it);
     }
-    it++;
-  }
 
-  if (force || /*(supercluster.planes.count(0) &&
-       supercluster.planes.count(1)) ||*/
-      (!supercluster.contents.empty() && !leftovers.empty() &&
-       (supercluster.time_end + time_slack_ < leftovers.rbegin()->time_start)))
-  {
+    //latest starting leftover
+    if (it != clusters.end())
+      leftover = std::prev(clusters.end());
+
+    if (!force &&
+        (supercluster_.empty() || (leftover == clusters.end()) ||
+         (supercluster.time_end + time_slack_ >= leftover->second.time_start)))
+      return false;
+
     SimpleEvent event;
-    for (auto eventlet: supercluster.contents)
-      event.insert_eventlet(eventlet);
-    ready_events_.push_back(event);
-
-//    if ((x.size() > 1) && (y.size() > 1))
-//    {
-//      DBG << "Multiplet\n";
-//      for (auto xx : x)
-//        DBG << xx.debug() << "\n";
-//      for (auto yy : y)
-//        DBG << yy.debug() << "\n";
-//      ready_events_.push_back(event);
-//    }
+    for (auto c : supercluster_)
+    {
+      const auto &cluster = c->second;
+      for (size_t i = 0; i < cluster.size(); ++i)
+        event.insert_eventlet(cluster[i]);
+      clusters.erase(c);
+    }
+    ready_events_.push_back(std::move(event));
+    budget_--;
 
     //    DBG << "Made event with " << event.x_.entries.size()
     //        << " " << event.y_.entries.size();
-    clustered_ = leftovers;
 
-    //recursively correlate leftovers
-    correlate(force && !clustered_.empty());
+    if (clusters.empty())
+      return true;
   }
+  return false;
 }
 
 
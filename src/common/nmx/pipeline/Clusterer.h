@@ -8,9 +8,9 @@
 #pragma once
 
 #include <SimpleEvent.h>
-#include <Cluster.h>
+#include <ActiveClusters.h>
+#include <deque>
 #include <list>
-#include <set>
 
 namespace NMX {
 
@@ -19,8 +19,12 @@ public:
 
   /** @brief create an NMX event clusterer
    * @param min_time_gap minimum timebins between clusters
+   * @param correlation_bound most events formed per insert, 0 for no
+   *        bound; the rest are formed on later inserts, as they would have
+   *        been without the bound
    */
-  Clusterer(uint16_t time_slack, uint16_t strip_slack, uint16_t cor_time_slack);
+  Clusterer(uint16_t time_slack, uint16_t strip_slack, uint16_t cor_time_slack,
+            size_t correlation_bound = 0);
 
   /** @brief add eventlet onto the clustering stack
    * @param eventlet with valid timestamp and non-zero adc value
@@ -50,15 +54,26 @@ private:
   uint16_t time_slack_ {28};
   uint16_t strip_slack_ {18};
   uint16_t correlation_time_slack_ {1};
+  size_t correlation_bound_ {0};
 
-  std::list<MacroCluster> clusters_x_;
-  std::list<MacroCluster> clusters_y_;
+  //eventlets of all clusters, must outlive them
+  MicroclusterPool pool_;
 
-  std::multiset<MacroCluster, MacroCluster::CompareStartTime> clustered_;
+  ActiveClusters clusters_x_;
+  ActiveClusters clusters_y_;
+
+  ActiveClusters::Retired clustered_;
+  //clusters of forced correlations left over by the bound, oldest first
+  std::deque<ActiveClusters::Retired> forced_;
+  std::vector<ActiveClusters::Retired::iterator> supercluster_;
+  size_t budget_ {0};
 
   std::list<SimpleEvent> ready_events_;
 
   void correlate(bool force = false);
+  //continues forced correlations, forming at most bound events (0 for all)
+  bool resume(size_t bound);
+  bool sweep(ActiveClusters::Retired &clusters, bool force);
 };
 
 }
@@ -0,0 +1,210 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include <CompactBlock.h>
+#include <algorithm>
+
+namespace NMX {
+
+namespace {
+
+uint8_t bits_for(uint64_t v)
+{
+  uint8_t ret {0};
+  while (v)
+  {
+    ++ret;
+    v >>= 1;
+  }
+  return ret;
+}
+
+uint64_t zigzag(uint64_t current, uint64_t previous)
+{
+  int64_t d = static_cast<int64_t>(current - previous);
+  return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+uint64_t unzigzag(uint64_t previous, uint64_t z)
+{
+  uint64_t d = (z >> 1) ^ (~(z & 1) + 1);
+  return previous + d;
+}
+
+uint64_t flag_word(const Eventlet& e)
+{
+  return uint64_t(e.flag) | (uint64_t(e.over_threshold) << 1);
+}
+
+class BitWriter
+{
+public:
+  BitWriter(std::vector<uint32_t>& stream) : stream_(stream) {}
+
+  void push(uint64_t val, uint8_t bits)
+  {
+    while (bits)
+    {
+      if (!free_)
+      {
+        stream_.push_back(0);
+        free_ = 32;
+      }
+      uint8_t n = std::min(bits, free_);
+      uint64_t part = val & ((uint64_t(1) << n) - 1);
+      stream_.back() |= static_cast<uint32_t>(part << (32 - free_));
+      val >>= n;
+      bits -= n;
+      free_ -= n;
+    }
+  }
+
+private:
+  std::vector<uint32_t>& stream_;
+  uint8_t free_ {0};
+};
+
+class BitReader
+{
+public:
+  BitReader(const uint32_t* words) : words_(words) {}
+
+  void skip(size_t bits)
+  {
+    pos_ += bits;
+  }
+
+  uint64_t pull(uint8_t bits)
+  {
+    uint64_t ret {0};
+    uint8_t done {0};
+    while (done < bits)
+    {
+      uint8_t offset = pos_ % 32;
+      uint8_t n = std::min<uint8_t>(bits - done, 32 - offset);
+      uint64_t part = (words_[pos_ / 32] >> offset) & ((uint64_t(1) << n) - 1);
+      ret |= part << done;
+      done += n;
+      pos_ += n;
+    }
+    return ret;
+  }
+
+private:
+  const uint32_t* words_;
+  size_t pos_ {0};
+};
+
+}
+
+size_t CompactBlock::bits_per_eventlet() const
+{
+  return size_t(delta_bits) + plane_bits + strip_bits + adc_bits + flag_bits;
+}
+
+size_t CompactBlock::word_count() const
+{
+  return (count * bits_per_eventlet() + 31) / 32;
+}
+
+CompactBlock CompactBlock::encode(const Eventlet* eventlets, size_t count,
+                                  uint64_t first_row,
+                                  std::vector<uint32_t>& stream)
+{
+  CompactBlock ret;
+  ret.first_row = first_row;
+  ret.word_offset = stream.size();
+  ret.count = count;
+  if (!count)
+    return ret;
+
+  ret.first_time = eventlets[0].time;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const auto& e = eventlets[i];
+    if (i)
+      ret.delta_bits = std::max(ret.delta_bits,
+                                bits_for(zigzag(e.time, eventlets[i-1].time)));
+    ret.plane_bits = std::max(ret.plane_bits, bits_for(e.plane));
+    ret.strip_bits = std::max(ret.strip_bits, bits_for(e.strip));
+    ret.adc_bits = std::max(ret.adc_bits, bits_for(e.adc));
+    ret.flag_bits = std::max(ret.flag_bits, bits_for(flag_word(e)));
+  }
+
+  stream.reserve(stream.size() + ret.word_count());
+  BitWriter writer(stream);
+  for (size_t i = 0; i < count; ++i)
+  {
+    const auto& e = eventlets[i];
+    uint64_t previous = i ? eventlets[i-1].time : ret.first_time;
+    writer.push(zigzag(e.time, previous), ret.delta_bits);
+    writer.push(e.plane, ret.plane_bits);
+    writer.push(e.strip, ret.strip_bits);
+    writer.push(e.adc, ret.adc_bits);
+    writer.push(flag_word(e), ret.flag_bits);
+  }
+  return ret;
+}
+
+void CompactBlock::decode(const uint32_t* words, size_t skip, size_t num,
+                          std::vector<Eventlet>& out) const
+{
+  if (skip >= count)
+    return;
+  num = std::min(num, count - skip);
+
+  BitReader reader(words);
+  uint64_t time = first_time;
+  size_t other_bits = bits_per_eventlet() - delta_bits;
+
+  //times are cumulative, so deltas must be walked up to the first wanted one
+  for (size_t i = 0; i < skip; ++i)
+  {
+    time = unzigzag(time, reader.pull(delta_bits));
+    reader.skip(other_bits);
+  }
+
+  for (size_t i = 0; i < num; ++i)
+  {
+    Eventlet e;
+    time = unzigzag(time, reader.pull(delta_bits));
+    e.time = time;
+    e.plane = reader.pull(plane_bits);
+    e.strip = reader.pull(strip_bits);
+    e.adc = reader.pull(adc_bits);
+    uint64_t flags = reader.pull(flag_bits);
+    e.flag = flags & 0x1;
+    e.over_threshold = (flags >> 1) & 0x1;
+    out.push_back(e);
+  }
+}
+
+void CompactBlock::to_h5(std::vector<uint64_t>& row) const
+{
+  row.resize(4);
+  row[0] = first_row;
+  row[1] = first_time;
+  row[2] = word_offset;
+  row[3] = uint64_t(count)
+      | (uint64_t(delta_bits) << 32)
+      | (uint64_t(plane_bits) << 40)
+      | (uint64_t(strip_bits) << 46)
+      | (uint64_t(adc_bits) << 52)
+      | (uint64_t(flag_bits) << 58);
+}
+
+CompactBlock CompactBlock::from_h5(const uint64_t* row)
+{
+  CompactBlock ret;
+  ret.first_row = row[0];
+  ret.first_time = row[1];
+  ret.word_offset = row[2];
+  ret.count = row[3] & 0xFFFFFFFF;
+  ret.delta_bits = (row[3] >> 32) & 0x7F;
+  ret.plane_bits = (row[3] >> 40) & 0x1F;
+  ret.strip_bits = (row[3] >> 46) & 0x1F;
+  ret.adc_bits = (row[3] >> 52) & 0x1F;
+  ret.flag_bits = (row[3] >> 58) & 0x3;
+  return ret;
+}
+
+}
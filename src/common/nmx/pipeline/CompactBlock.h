@@ -0,0 +1,54 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Delta-encoded, bit-packed blocks of eventlets
+ */
+
+#pragma once
+
+#include <Eventlet.h>
+
+namespace NMX {
+
+/** Eventlet times are stored as zigzag-encoded deltas from the previous
+ *  eventlet of the block, followed by plane, strip, adc and flag bits.
+ *  Each field uses the minimum bit width required within its block, and
+ *  each block starts on a fresh 32-bit word so that it can be decoded
+ *  independently of all others.
+ */
+struct CompactBlock
+{
+  uint64_t first_row {0};   // index of first eventlet in stream
+  uint64_t first_time {0};  // time of first eventlet
+  uint64_t word_offset {0}; // index of first word in packed stream
+  uint32_t count {0};       // number of eventlets in block
+
+  uint8_t delta_bits {0};
+  uint8_t plane_bits {0};
+  uint8_t strip_bits {0};
+  uint8_t adc_bits   {0};
+  uint8_t flag_bits  {0};
+
+  size_t bits_per_eventlet() const;
+  size_t word_count() const;
+  uint64_t end_row() const { return first_row + count; }
+
+  /** @brief encodes eventlets and appends packed words to stream
+   * @returns block descriptor, with word_offset pointing into stream
+   */
+  static CompactBlock encode(const Eventlet* eventlets, size_t count,
+                             uint64_t first_row,
+                             std::vector<uint32_t>& stream);
+
+  /** @brief decodes eventlets [first_row + skip, first_row + skip + num)
+   * @param words packed words of this block, starting at word_offset
+   */
+  void decode(const uint32_t* words, size_t skip, size_t num,
+              std::vector<Eventlet>& out) const;
+
+  void to_h5(std::vector<uint64_t>& row) const;
+  static CompactBlock from_h5(const uint64_t* row);
+};
+
+}
@@ -0,0 +1,107 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include <Correlator.h>
+
+namespace NMX {
+
+Correlator::Correlator(uint16_t time_slack, uint16_t strip_slack)
+  : time_slack_(time_slack)
+  , strip_slack_(strip_slack)
+  , pool_(64, Microcluster(16))
+{}
+
+void Correlator::add(const RetiredClusters &retired)
+{
+  size_t begin {0};
+  for (auto end : retired.ends)
+  {
+    MacroCluster cluster(pool_, time_slack_, strip_slack_);
+    for (size_t i = begin; i < end; ++i)
+      cluster.insert(retired.eventlets[i]);
+    begin = end;
+    insert(std::move(cluster));
+  }
+}
+
+void Correlator::insert(MacroCluster &&cluster)
+{
+  //planes arrive in any order, so place by plane among equal time_start
+  uint64_t start = cluster.time_start;
+  auto it = clustered_.lower_bound(start);
+  while ((it != clustered_.end()) && (it->first == start) &&
+         (it->second.planes <= cluster.planes))
+    ++it;
+  clustered_.emplace_hint(it, start, std::move(cluster));
+}
+
+void Correlator::correlate(uint64_t watermark)
+{
+  sweep(watermark, false);
+}
+
+void Correlator::dump()
+{
+  sweep(0, true);
+}
+
+bool Correlator::events_ready() const
+{
+  return !ready_events_.empty();
+}
+
+std::list<SimpleEvent> Correlator::pop_events()
+{
+  std::list<SimpleEvent> ret;
+  ret.swap(ready_events_);
+  return ret;
+}
+
+bool Correlator::empty() const
+{
+  return clustered_.empty() && ready_events_.empty();
+}
+
+size_t Correlator::size() const
+{
+  return clustered_.size();
+}
+
+void Correlator::sweep(uint64_t watermark, bool force)
+{
+  while (!clustered_.empty())
+  {
+    //clusters overlapping in time with the first one, in order of start
+    //time, with the time slack of the first as in Clusterer
+    supercluster_.clear();
+    auto first = clustered_.begin();
+    MacroCluster supercluster = first->second.bounds();
+    supercluster_.push_back(first);
+    for (auto it = std::next(first); it != clustered_.end(); ++it)
+    {
+      //this and later ones start too late to overlap
+      if (!supercluster.time_adjacent(it->first))
+        break;
+      if (supercluster.time_overlap(it->second))
+      {
+        supercluster.extend(it->second);
+        supercluster_.push_back(it);
+      }
+    }
+
+    //clusters yet to arrive start at or after watermark
+    if (!force && ((supercluster.time_end + time_slack_) >= watermark))
+      return;
+
+    SimpleEvent event;
+    for (auto c : supercluster_)
+    {
+      const auto &cluster = c->second;
+      for (size_t i = 0; i < cluster.size(); ++i)
+        event.insert_eventlet(cluster[i]);
+      clustered_.erase(c);
+    }
+    ready_events_.push_back(std::move(event));
+  }
+}
+
+}
@@ -0,0 +1,63 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Correlation of clusters retired by separate planes into events
+ */
+
+#pragma once
+
+#include <SimpleEvent.h>
+#include <PlaneClusterer.h>
+#include <list>
+
+namespace NMX {
+
+/** @brief forms events from clusters that PlaneClusterers retired, as
+ *  Clusterer does for both planes at once. Clusters overlapping in time,
+ *  within the time slack of the earliest, make one event. An event is only
+ *  formed once no cluster that could still arrive would overlap it, so the
+ *  events do not depend on how the planes' clusters were interleaved.
+ */
+class Correlator
+{
+public:
+  Correlator(uint16_t time_slack, uint16_t strip_slack);
+
+  /** @brief takes over clusters retired by one plane
+   */
+  void add(const RetiredClusters &retired);
+
+  /** @brief forms events from clusters ending more than time_slack before
+   *  watermark, which is the lowest watermark of all planes
+   */
+  void correlate(uint64_t watermark);
+
+  /** @brief forms events from all remaining clusters
+   */
+  void dump();
+
+  bool events_ready() const;
+  std::list<SimpleEvent> pop_events();
+
+  bool empty() const;
+  size_t size() const;
+
+private:
+  uint16_t time_slack_ {28};
+  uint16_t strip_slack_ {18};
+
+  //eventlets of all clusters, must outlive them
+  MicroclusterPool pool_;
+
+  //for equal time_start, in order of plane
+  ActiveClusters::Retired clustered_;
+  std::vector<ActiveClusters::Retired::iterator> supercluster_;
+
+  std::list<SimpleEvent> ready_events_;
+
+  void insert(MacroCluster &&cluster);
+  void sweep(uint64_t watermark, bool force);
+};
+
+}
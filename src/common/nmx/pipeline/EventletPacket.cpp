@@ -10,9 +10,9 @@ EventletPacket::EventletPacket(size_t size)
 
 void EventletPacket::add(const Eventlet& e)
 {
-  eventlets.push_back(e);
-  if (!eventlets.size())
+  if (eventlets.empty())
     time_start = time_end = e.time;
+  eventlets.push_back(e);
   time_start = std::min(time_start, e.time);
   time_end = std::max(time_end, e.time);
 }
@@ -14,7 +14,8 @@ class EventletPacket
     void clear_and_keep_capacity();
 
     std::vector<Eventlet> eventlets;
-    uint64_t time_start, time_end;
+    uint64_t time_start {0};
+    uint64_t time_end {0};
 
     std::vector<uint32_t> to_h5() const;
     void to_h5(std::vector<uint32_t>& packet) const;
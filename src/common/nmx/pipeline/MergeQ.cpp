@@ -0,0 +1,176 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include <MergeQ.h>
+#include <algorithm>
+
+namespace NMX {
+
+bool MergeQ::Head::operator<(const Head& o) const
+{
+  if (time != o.time)
+    return time > o.time;
+  if (strip != o.strip)
+    return strip > o.strip;
+  return arrival > o.arrival;
+}
+
+MergeQ::MergeQ(uint64_t latency)
+  : latency_(latency)
+{}
+
+void MergeQ::sort(std::vector<Eventlet>& eventlets)
+{
+  auto by_time_strip = [](const Eventlet& a, const Eventlet& b)
+  {
+    return (a.time < b.time) || ((a.time == b.time) && (a.strip < b.strip));
+  };
+
+  uint64_t first = eventlets.front().time;
+  uint64_t last = first;
+  for (const auto& e : eventlets)
+  {
+    first = std::min(first, e.time);
+    last = std::max(last, e.time);
+  }
+
+  //packets usually span few timestamps, count them out
+  size_t span = last - first + 1;
+  if ((last - first) >= (4 * eventlets.size()))
+  {
+    std::stable_sort(eventlets.begin(), eventlets.end(), by_time_strip);
+    return;
+  }
+
+  counts_.assign(span + 1, 0);
+  for (const auto& e : eventlets)
+    counts_[e.time - first + 1]++;
+  for (size_t i = 1; i < span; ++i)
+    counts_[i] += counts_[i - 1];
+  sorted_.resize(eventlets.size());
+  for (const auto& e : eventlets)
+    sorted_[counts_[e.time - first]++] = e;
+
+  //then by strip within each timestamp
+  for (size_t i = 1; i < sorted_.size(); ++i)
+  {
+    auto e = sorted_[i];
+    size_t j = i;
+    for (; j && by_time_strip(e, sorted_[j - 1]); --j)
+      sorted_[j] = sorted_[j - 1];
+    sorted_[j] = e;
+  }
+  eventlets.swap(sorted_);
+}
+
+void MergeQ::push(EventletPacket&& packet)
+{
+  if (packet.eventlets.empty())
+    return;
+
+  size_t r;
+  if (free_runs_.empty())
+  {
+    r = runs_.size();
+    runs_.push_back(Run());
+  }
+  else
+  {
+    r = free_runs_.back();
+    free_runs_.pop_back();
+  }
+
+  auto& run = runs_[r];
+  run.packet = std::move(packet);
+  run.next = 0;
+  auto& eventlets = run.packet.eventlets;
+  sort(eventlets);
+  run.packet.time_start = eventlets.front().time;
+  run.packet.time_end = eventlets.back().time;
+
+  current_latest_ = std::max(current_latest_, run.packet.time_start);
+  size_ += eventlets.size();
+
+  heads_.push_back(head(r, arrivals_++));
+  std::push_heap(heads_.begin(), heads_.end());
+}
+
+size_t MergeQ::size() const
+{
+  return size_;
+}
+
+bool MergeQ::empty() const
+{
+  return !size_;
+}
+
+bool MergeQ::ready() const
+{
+  return (!heads_.empty() &&
+          ((heads_.front().time + latency_) < current_latest_));
+}
+
+Eventlet MergeQ::pop()
+{
+  auto& top = heads_.front();
+  auto& run = runs_[top.run];
+  auto ret = run.packet.eventlets[run.next++];
+  size_--;
+
+  if (run.next < run.packet.eventlets.size())
+    top = head(top.run, top.arrival);
+  else
+  {
+    run.packet.clear_and_keep_capacity();
+    free_runs_.push_back(top.run);
+    top = heads_.back();
+    heads_.pop_back();
+  }
+  sift_down();
+  return ret;
+}
+
+size_t MergeQ::pop(EventletPacket& packet)
+{
+  size_t ret {0};
+  while (ready())
+  {
+    packet.add(pop());
+    ret++;
+  }
+  return ret;
+}
+
+void MergeQ::sift_down()
+{
+  //top head may have moved back, restore heap order below it
+  size_t n = heads_.size();
+  size_t i = 0;
+  while (true)
+  {
+    size_t first = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if ((left < n) && (heads_[first] < heads_[left]))
+      first = left;
+    if ((right < n) && (heads_[first] < heads_[right]))
+      first = right;
+    if (first == i)
+      return;
+    std::swap(heads_[i], heads_[first]);
+    i = first;
+  }
+}
+
+MergeQ::Head MergeQ::head(size_t run, uint64_t arrival) const
+{
+  const auto& e = runs_[run].packet.eventlets[runs_[run].next];
+  Head ret;
+  ret.time = e.time;
+  ret.strip = e.strip;
+  ret.arrival = arrival;
+  ret.run = run;
+  return ret;
+}
+
+}
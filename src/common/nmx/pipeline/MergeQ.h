@@ -0,0 +1,72 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Class for NMX event clustering
+ */
+
+#pragma once
+
+#include <EventletPacket.h>
+
+namespace NMX {
+
+/** @brief streaming k-way merge of packets of eventlets.
+ *  Each packet is sorted once on arrival and merged through a heap of
+ *  packet heads, so eventlets come out in order of time, then strip,
+ *  then arrival. Eventlets may arrive up to latency later than the
+ *  start of the latest packet; those further behind are ready.
+ */
+class MergeQ
+{
+public:
+  MergeQ(uint64_t latency);
+
+  void push(EventletPacket&& packet);
+  bool ready() const;
+  bool empty() const;
+  size_t size() const;
+  Eventlet pop();
+
+  /** @brief appends all ready eventlets to packet, in order of pop()
+   * @returns number of eventlets appended
+   */
+  size_t pop(EventletPacket& packet);
+
+private:
+  uint64_t latency_;
+  uint64_t current_latest_{0};
+  uint64_t arrivals_{0};
+  size_t size_{0};
+
+  struct Run
+  {
+    EventletPacket packet;
+    size_t next {0};
+  };
+
+  struct Head
+  {
+    uint64_t time;
+    uint16_t strip;
+    uint64_t arrival;
+    size_t run;
+
+    //true if o comes out first, for a std heap with the earliest on top
+    bool operator<(const Head& o) const;
+  };
+
+  std::vector<Run> runs_;
+  std::vector<size_t> free_runs_;
+  std::vector<Head> heads_;
+
+  //for sorting packets
+  std::vector<Eventlet> sorted_;
+  std::vector<size_t> counts_;
+
+  Head head(size_t run, uint64_t arrival) const;
+  void sift_down();
+  void sort(std::vector<Eventlet>& eventlets);
+};
+
+}
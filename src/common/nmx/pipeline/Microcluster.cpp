@@ -36,6 +36,11 @@ Eventlet& Microcluster::operator [] (size_t i)
   return data_[i];
 }
 
+const Eventlet& Microcluster::operator [] (size_t i) const
+{
+  return data_[i];
+}
+
 Eventlet& Microcluster::at(size_t i)
 {
   return data_.at(i);
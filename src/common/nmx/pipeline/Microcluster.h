@@ -19,6 +19,7 @@ class Microcluster
 
     Eventlet& at(size_t i);
     Eventlet& operator [] (size_t i);
+    const Eventlet& operator [] (size_t i) const;
 
     void operator++();
 
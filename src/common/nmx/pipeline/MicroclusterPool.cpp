@@ -5,6 +5,7 @@
 namespace NMX {
 
 MicroclusterPool::MicroclusterPool(size_t s, Microcluster prototype)
+  : prototype_(prototype)
 {
   data_.resize(s, prototype);
   free_.reserve(s);
@@ -35,11 +36,26 @@ size_t MicroclusterPool::requisition()
   return ret;
 }
 
+size_t MicroclusterPool::requisition_or_grow()
+{
+  if (free_.empty())
+  {
+    data_.push_back(prototype_);
+    return data_.size() - 1;
+  }
+  return requisition();
+}
+
 Microcluster& MicroclusterPool::operator [] (size_t i)
 {
   return data_[i];
 }
 
+const Microcluster& MicroclusterPool::operator [] (size_t i) const
+{
+  return data_[i];
+}
+
 
 
 }
@@ -18,9 +18,14 @@ class MicroclusterPool
     void release(size_t i);
     size_t requisition();
 
+    //as requisition(), adding a copy of the prototype if none are free
+    size_t requisition_or_grow();
+
     Microcluster& operator [] (size_t i);
+    const Microcluster& operator [] (size_t i) const;
 
   private:
+    Microcluster prototype_;
     std::vector<Microcluster> data_;
     std::vector<size_t> free_;
 };
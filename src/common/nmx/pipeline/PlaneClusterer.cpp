@@ -0,0 +1,62 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include <PlaneClusterer.h>
+#include <algorithm>
+#include <limits>
+
+namespace NMX {
+
+PlaneClusterer::PlaneClusterer(uint16_t time_slack, uint16_t strip_slack)
+  : pool_(64, Microcluster(16))
+  , clusters_(pool_, time_slack, strip_slack)
+{}
+
+void PlaneClusterer::insert(const Eventlet &eventlet)
+{
+  latest_ = std::max(latest_, eventlet.time);
+  dumped_ = false;
+  if (!eventlet.adc)
+    return;
+
+  if (clusters_.join(eventlet))
+    return;
+
+  clusters_.open(eventlet);
+  clusters_.retire(eventlet.time, retired_);
+}
+
+void PlaneClusterer::advance(uint64_t time)
+{
+  latest_ = std::max(latest_, time);
+}
+
+void PlaneClusterer::dump()
+{
+  clusters_.retire_all(retired_);
+  dumped_ = true;
+}
+
+void PlaneClusterer::pop(RetiredClusters &retired)
+{
+  retired.eventlets.clear();
+  retired.ends.clear();
+  for (const auto &c : retired_)
+  {
+    const auto &cluster = c.second;
+    for (size_t i = 0; i < cluster.size(); ++i)
+      retired.eventlets.push_back(cluster[i]);
+    retired.ends.push_back(retired.eventlets.size());
+  }
+  retired_.clear();
+  retired.watermark = watermark();
+}
+
+uint64_t PlaneClusterer::watermark() const
+{
+  if (dumped_)
+    return std::numeric_limits<uint64_t>::max();
+  //later clusters are opened by eventlets no earlier than latest_
+  return std::min(latest_, clusters_.time_start());
+}
+
+}
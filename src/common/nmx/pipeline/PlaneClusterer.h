@@ -0,0 +1,65 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Clustering of a single plane, for a separate correlator
+ */
+
+#pragma once
+
+#include <ActiveClusters.h>
+
+namespace NMX {
+
+/** @brief clusters retired by one plane, with their eventlets copied out
+ *  of its pool so that they can be handed to another thread
+ */
+struct RetiredClusters
+{
+  std::vector<Eventlet> eventlets;
+  //end of each cluster's eventlets, in order of time_start
+  std::vector<size_t> ends;
+  //no cluster retired later by the plane starts before this
+  uint64_t watermark {0};
+};
+
+/** @brief clusters the eventlets of one plane as Clusterer does, retiring
+ *  clusters whenever a new one is opened
+ */
+class PlaneClusterer
+{
+public:
+  PlaneClusterer(uint16_t time_slack, uint16_t strip_slack);
+
+  /** @brief add eventlet of this plane onto the clustering stack
+   * @param eventlet MUST BE IN CHRONOLOGICAL ORDER!
+   */
+  void insert(const Eventlet &eventlet);
+
+  /** @brief eventlets still to come are no earlier than time, which
+   *  advances the watermark while the plane is quiet
+   */
+  void advance(uint64_t time);
+
+  /** @brief retires all clusters, the watermark is then max
+   */
+  void dump();
+
+  /** @brief moves out clusters retired since the last call
+   */
+  void pop(RetiredClusters &retired);
+
+  uint64_t watermark() const;
+
+private:
+  //eventlets of all clusters, must outlive them
+  MicroclusterPool pool_;
+
+  ActiveClusters clusters_;
+  ActiveClusters::Retired retired_;
+
+  uint64_t latest_ {0};
+  bool dumped_ {false};
+};
+
+}
@@ -0,0 +1,242 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Bounded queue between two pipeline stages
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace NMX {
+
+/** @brief bounded lock-free ring for exactly one producer thread and one
+ *  consumer thread. push() waits while the ring is full, so a slow
+ *  consumer holds back its producer. Waiting spins briefly, then parks on
+ *  a condition variable until the other side makes progress.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+  /** @brief capacity is rounded up to a power of two
+   */
+  explicit SPSCQueue(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  size_t capacity() const { return slots_.size(); }
+
+  size_t size() const
+  {
+    return tail_.load(std::memory_order_acquire) -
+        head_.load(std::memory_order_acquire);
+  }
+
+  /** @brief producer only; moves from item on success
+   */
+  bool try_push(T& item)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t depth = tail - head_.load(std::memory_order_acquire);
+    if (depth >= slots_.size())
+      return false;
+    slots_[tail & mask_] = std::move(item);
+    tail_.store(tail + 1, std::memory_order_release);
+    wake(consumer_parked_);
+
+    pushes_++;
+    depth_sum_ += depth + 1;
+    max_depth_ = std::max(max_depth_, depth + 1);
+    return true;
+  }
+
+  /** @brief producer only; waits while full
+   */
+  void push(T&& item)
+  {
+    if (try_push(item))
+      return;
+    full_waits_++;
+    for (size_t spin = 0; !try_push(item); ++spin)
+    {
+      if (spin < spin_limit)
+        std::this_thread::yield();
+      else
+        park(producer_parked_, [this]{ return writable(); });
+    }
+  }
+
+  /** @brief producer only; no pushes may follow
+   */
+  void close()
+  {
+    closed_.store(true, std::memory_order_release);
+    wake(consumer_parked_);
+  }
+
+  /** @brief consumer only
+   */
+  bool try_pop(T& item)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return false;
+    item = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    wake(producer_parked_);
+    return true;
+  }
+
+  /** @brief consumer only; waits while empty
+   * @returns false once closed and drained
+   */
+  bool pop(T& item)
+  {
+    if (try_pop(item))
+      return true;
+    empty_waits_++;
+    for (size_t spin = 0; ; ++spin)
+    {
+      //anything pushed before close is visible once closed is
+      bool closed = closed_.load(std::memory_order_acquire);
+      if (try_pop(item))
+        return true;
+      if (closed)
+        return false;
+      if (spin < spin_limit)
+        std::this_thread::yield();
+      else
+        park(consumer_parked_, [this]{ return readable(); });
+    }
+  }
+
+  /** @brief consumer only
+   * @returns true once closed and drained
+   */
+  bool drained() const
+  {
+    bool closed = closed_.load(std::memory_order_acquire);
+    return closed && (head_.load(std::memory_order_relaxed) ==
+                      tail_.load(std::memory_order_acquire));
+  }
+
+  //producer side statistics
+  size_t pushes() const { return pushes_; }
+  size_t max_depth() const { return max_depth_; }
+  double mean_depth() const { return pushes_ ? double(depth_sum_) / pushes_ : 0.0; }
+  size_t full_waits() const { return full_waits_; }
+
+  //consumer side statistics
+  size_t empty_waits() const { return empty_waits_; }
+
+private:
+  //yields before a waiting side parks
+  static constexpr size_t spin_limit {64};
+
+  bool writable() const
+  {
+    return (tail_.load(std::memory_order_relaxed) -
+            head_.load(std::memory_order_acquire)) < slots_.size();
+  }
+
+  bool readable() const
+  {
+    return closed_.load(std::memory_order_acquire) ||
+        (head_.load(std::memory_order_relaxed) !=
+         tail_.load(std::memory_order_acquire));
+  }
+
+  //the fences pair with those in wake(): either the parking side sees the
+  //progress in ready(), or the other side sees it parked and notifies it
+  template<typename Ready>
+  void park(std::atomic<bool>& parked, Ready ready)
+  {
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    park_cond_.wait(lock, ready);
+    parked.store(false, std::memory_order_relaxed);
+  }
+
+  void wake(const std::atomic<bool>& parked)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!parked.load(std::memory_order_relaxed))
+      return;
+    std::lock_guard<std::mutex> lock(park_mutex_);
+    park_cond_.notify_all();
+  }
+
+  std::vector<T> slots_;
+  size_t mask_ {1};
+
+  //keeps consumer and producer members on separate cache lines, padded
+  //rather than aligned as heap allocations need not honour alignas
+  char pad_head_[64];
+  std::atomic<size_t> head_ {0};
+  std::atomic<bool> consumer_parked_ {false};
+  size_t empty_waits_ {0};
+
+  char pad_tail_[64];
+  std::atomic<size_t> tail_ {0};
+  std::atomic<bool> closed_ {false};
+  size_t pushes_ {0};
+  size_t depth_sum_ {0};
+  size_t max_depth_ {0};
+  size_t full_waits_ {0};
+  std::atomic<bool> producer_parked_ {false};
+
+  char pad_park_[64];
+  std::mutex park_mutex_;
+  std::condition_variable park_cond_;
+};
+
+template<typename T>
+constexpr size_t SPSCQueue<T>::spin_limit;
+
+/** @brief waits of a loop polling several queues: yields at first, then
+ *  sleeps for doubling periods of up to a millisecond
+ */
+class Backoff
+{
+public:
+  void wait()
+  {
+    if (waits_++ < 64)
+    {
+      std::this_thread::yield();
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(sleep_us_));
+    sleep_us_ = std::min<size_t>(sleep_us_ * 2, 1000);
+  }
+
+  void reset()
+  {
+    waits_ = 0;
+    sleep_us_ = 10;
+  }
+
+private:
+  size_t waits_ {0};
+  size_t sleep_us_ {10};
+};
+
+}
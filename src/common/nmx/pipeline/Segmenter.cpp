@@ -0,0 +1,47 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include <Segmenter.h>
+#include <algorithm>
+
+namespace NMX {
+
+Segmenter::Segmenter(uint16_t time_slack, size_t min_eventlets)
+  : time_slack_(time_slack)
+  , min_eventlets_(min_eventlets)
+{}
+
+std::vector<EventletPacket> Segmenter::split(EventletPacket&& packet)
+{
+  std::vector<EventletPacket> ret;
+  const auto& eventlets = packet.eventlets;
+  size_t begin {0};
+  for (size_t i = 0; i < eventlets.size(); ++i)
+  {
+    if (!eventlets[i].adc)
+      continue;
+    uint64_t time = eventlets[i].time;
+    if (eventlets_ && (eventlets_ >= min_eventlets_) &&
+        (time > (latest_ + time_slack_)))
+    {
+      ret.push_back(EventletPacket(i - begin));
+      for (size_t j = begin; j < i; ++j)
+        ret.back().add(eventlets[j]);
+      begin = i;
+      eventlets_ = 0;
+    }
+    latest_ = std::max(latest_, time);
+    eventlets_++;
+  }
+
+  if (!begin)
+    ret.push_back(std::move(packet));
+  else
+  {
+    ret.push_back(EventletPacket(eventlets.size() - begin));
+    for (size_t j = begin; j < eventlets.size(); ++j)
+      ret.back().add(eventlets[j]);
+  }
+  return ret;
+}
+
+}
@@ -0,0 +1,42 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+/** @file
+ *
+ *  @brief Cuts an eventlet stream into independently clusterable segments
+ */
+
+#pragma once
+
+#include <EventletPacket.h>
+#include <vector>
+
+namespace NMX {
+
+/** @brief cuts the time ordered eventlet stream fed to a Clusterer into
+ *  segments. A segment may end once it holds min_eventlets and the next
+ *  eventlet comes more than time_slack after the latest one so far. No
+ *  cluster spans such a gap, so clustering each segment on its own, dumping
+ *  the clusterer at its end, gives the same events as clustering the whole
+ *  stream. Eventlets the Clusterer ignores (zero adc) never end a segment.
+ */
+class Segmenter
+{
+public:
+  Segmenter(uint16_t time_slack, size_t min_eventlets);
+
+  /** @brief splits the next packet of the stream where segments end
+   * @returns at least one packet, in stream order; all but the last end
+   *          a segment, the last continues it and may be empty
+   */
+  std::vector<EventletPacket> split(EventletPacket&& packet);
+
+private:
+  uint16_t time_slack_ {0};
+  size_t min_eventlets_ {0};
+
+  //of the segment being filled
+  size_t eventlets_ {0};
+  uint64_t latest_ {0};
+};
+
+}
@@ -23,12 +23,13 @@ static const char USAGE[] =
     R"(nmx analyze
 
     Usage:
-    nmx_analyze INFILE OUTFILE [-v | --verbose]
+    nmx_analyze INFILE OUTFILE [-v | --verbose] [--compact]
     nmx_analyze (-h | --help)
 
     Options:
     -h --help      Show this screen.
     -v --verbose   Verbose
+    --compact      Write delta-encoded compact raw/VMM layout
     -s             Number of event to start with [default: 0]
     -n             Number of event to be processed [default: max]
     )";
@@ -109,7 +110,11 @@ int main(int argc, char* argv[])
 	try
 	{
     outfile.open(output_file, H5CC::Access::rw_truncate);
-    writer = make_shared<NMX::RawVMM>(outfile, 20);
+    if (args["--compact"].asBool())
+      writer = make_shared<NMX::RawVMM>(outfile, NMX::ChunkPolicy::automatic(0),
+                                        NMX::RawVMM::Layout::compact);
+    else
+      writer = make_shared<NMX::RawVMM>(outfile, 20);
   }
   catch (...)
 	{
@@ -18,12 +18,13 @@ static const char USAGE[] =
     R"(nmx analyze
 
     Usage:
-    nmx_analyze INFILE OUTFILE [-r]
+    nmx_analyze INFILE OUTFILE [-r] [--jobs N]
     nmx_analyze (-h | --help)
 
     Options:
     -h --help    Show this screen.
     -r           Recursive file search
+    --jobs N     Read N files concurrently [default: 1]
     )";
 
 int main(int argc, char* argv[])
@@ -39,15 +40,25 @@ int main(int argc, char* argv[])
   if (files.empty() || output_file.empty())
     return 1;
 
+  size_t jobs {1};
+  if (args["--jobs"])
+    jobs = args["--jobs"].asLong();
+
   std::cout << "Will analyse the following files:\n";
   for (auto p : files)
     std::cout << "   " << p << "\n";
 
+  //files are read by up to jobs workers, everything is merged and written
+  //from this thread in file order
   std::set<std::string> all_metric_names;
+  std::vector<std::set<std::string>> file_metric_names(files.size());
 
   auto prog = progbar(files.size(), "  Indexing metrics  ");
-  for (auto filename : files)
+  for_each_file(files, jobs,
+                [&](size_t i, const fs::path& filename)
   {
+    if (term_flag)
+      return;
     auto reader = std::make_shared<NMX::File>(filename.string(), H5CC::Access::r_existing);
 
     for (auto analysis : reader->analyses())
@@ -55,13 +66,17 @@ int main(int argc, char* argv[])
       reader->load_analysis(analysis);
       if (reader->num_analyzed())
         for (auto &metric : reader->metrics())
-          all_metric_names.insert(metric);
+          file_metric_names[i].insert(metric);
     }
-
+  },
+                [&](size_t i, const fs::path&)
+  {
+    all_metric_names.insert(file_metric_names[i].begin(), file_metric_names[i].end());
     ++(*prog);
-    if (term_flag)
-      return 0;
-  }
+    return !term_flag;
+  });
+  if (term_flag)
+    return 0;
 
   if (all_metric_names.empty())
   {
@@ -77,19 +92,30 @@ int main(int argc, char* argv[])
   for (auto metric : all_metric_names)
   {
     std::map<std::string, NMX::Metric> aggregates;
+    std::vector<std::list<std::pair<std::string, NMX::Metric>>> file_metrics(files.size());
 
-    for (auto filename : files)
+    for_each_file(files, jobs,
+                  [&](size_t i, const fs::path& filename)
     {
       auto reader = std::make_shared<NMX::File>(filename.string(), H5CC::Access::r_existing);
       for (auto analysis : reader->analyses())
       {
         reader->load_analysis(analysis);
         if (reader->num_analyzed())
-          aggregates[analysis].merge(reader->get_metric(metric));
+          file_metrics[i].push_back(std::make_pair(analysis, reader->get_metric(metric)));
         if (term_flag)
-          return 0;
+          return;
       }
-    }
+    },
+                  [&](size_t i, const fs::path&)
+    {
+      for (auto &m : file_metrics[i])
+        aggregates[m.first].merge(m.second);
+      file_metrics[i].clear();
+      return !term_flag;
+    });
+    if (term_flag)
+      return 0;
 
     for (auto a : aggregates)
     {
@@ -109,16 +135,15 @@ int main(int argc, char* argv[])
 
 
   auto ofilepath = fs::absolute(fs::path(output_file).root_path()).relative_path();
-  size_t fnum {0};
-  for (auto filename : files)
-  {
-    auto reader = std::make_shared<NMX::File>(filename.string(), H5CC::Access::r_existing);
 
-    std::string dataset = filename.stem().string();
-    auto relpath = relative_to(ofilepath, filename.relative_path());
+  //per file: analysis -> metric -> histogram
+  typedef std::map<std::string, std::map<std::string, std::map<double, double>>> FileHists;
+  std::vector<FileHists> file_hists(files.size());
 
-    INFO << "Processing file " << relpath.string()
-         << " (" << fnum+1 << "/" << files.size() << ")";
+  for_each_file(files, jobs,
+                [&](size_t i, const fs::path& filename)
+  {
+    auto reader = std::make_shared<NMX::File>(filename.string(), H5CC::Access::r_existing);
 
     for (auto analysis : reader->analyses())
     {
@@ -127,26 +152,48 @@ int main(int argc, char* argv[])
       if (!reader->num_analyzed())
         continue;
 
-      prog = progbar(reader->metrics().size(), "  Processing '" + analysis + "'  ");
-
+      auto& hists = file_hists[i][analysis];
       for (auto &metric : reader->metrics())
       {
-        all_metric_names.insert(metric);
-
         double norm = NMX::Metric::normalizer(minima.at(metric), maxima.at(metric));
-        auto hist = reader->get_metric(metric).make_histogram(norm);
+        hists[metric] = reader->get_metric(metric).make_histogram(norm);
+        if (term_flag)
+          return;
+      }
+    }
+  },
+                [&](size_t i, const fs::path& filename)
+  {
+    std::string dataset = filename.stem().string();
+    auto relpath = relative_to(ofilepath, filename.relative_path());
 
-        write(outfile.require_group(analysis).require_group(metric), dataset, hist);
+    INFO << "Processing file " << relpath.string()
+         << " (" << i+1 << "/" << files.size() << ")";
+
+    for (auto &a : file_hists[i])
+    {
+      auto analysis = a.first;
+      prog = progbar(a.second.size(), "  Processing '" + analysis + "'  ");
+
+      for (auto &h : a.second)
+      {
+        auto metric = h.first;
+        //workers may still be reading other files
+        std::lock_guard<std::mutex> io(NMX::io_mutex());
+        write(outfile.require_group(analysis).require_group(metric), dataset, h.second);
         outfile.open_group(analysis).open_group(metric).open_dataset(dataset).write_attribute("relpath", relpath.string());
 
         ++(*prog);
         if (term_flag)
-          return 0;
+          return false;
       }
     }
-    reader.reset();
-    ++fnum;
-  }
+    file_hists[i].clear();
+    return true;
+  });
+
+  if (term_flag)
+    return 0;
 
   INFO << "Building hists finished";
 
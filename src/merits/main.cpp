@@ -7,6 +7,7 @@
 #include "docopt.h"
 
 #include "Filter.h"
+#include <sstream>
 
 using namespace NMX;
 using namespace std;
@@ -16,11 +17,12 @@ static const char USAGE[] =
     R"(nmx merits
 
     Usage:
-    nmx_merits OUTFILE TEMPLATE PATH METRIC [-r]
+    nmx_merits OUTFILE TEMPLATE PATH METRIC [-r] [--jobs N]
     nmx_merits (-h | --help)
 
     Options:"
     -r           Recursive file search
+    --jobs N     Process N files concurrently [default: 1]
     -h --help    Show this screen.
     )";
 
@@ -64,8 +66,27 @@ int main(int argc, char* argv[])
   auto proj = args["METRIC"].asString();
   std::cout << "metric: " << proj << "\n";
 
-  for (auto p : files)
+  size_t jobs {1};
+  if (args["--jobs"])
+    jobs = args["--jobs"].asLong();
+
+  struct Result
   {
+    std::string gname;
+    std::string dataset;
+    std::string analysis;
+    FilterMerits merits;
+  };
+
+  //files are processed by up to jobs workers, results are printed and
+  //written from this thread in file order
+  std::vector<std::stringstream> logs(files.size());
+  std::vector<std::list<Result>> results(files.size());
+
+  for_each_file(files, jobs,
+                [&](size_t i, const path& p)
+  {
+    auto& log = logs[i];
     std::shared_ptr<NMX::File> reader;
     try
     {
@@ -75,8 +96,8 @@ int main(int argc, char* argv[])
     catch (...)
     {
       printException();
-      std::cout << "Could not open file " << p << "\n";
-      continue;
+      log << "Could not open file " << p << "\n";
+      return;
     }
     for (auto a : reader->analyses())
     {
@@ -85,29 +106,44 @@ int main(int argc, char* argv[])
         dsetname += p.stem().string();
       if (reader->analyses().size() > 1)
         dsetname += (dsetname.empty() ? "" : ".") + a;
-      std::cout << "dsetbasename:   " << dsetname << "\n";
+      log << "dsetbasename:   " << dsetname << "\n";
 
       reader->load_analysis(a);
 
       for (auto f : fm_templates)
       {
-        auto gname = dsetname
+        Result r;
+        r.gname = dsetname
             + (dsetname.empty() ? "" : ".")
             + f.first;
-        std::cout << "   doing " << gname << "\n";
-
-        auto ff = f.second;
+        log << "   doing " << r.gname << "\n";
 
-        ff.doit(*reader, proj);
+        r.merits = f.second;
+        r.merits.doit(*reader, proj);
 
-        H5CC::Group group = outfile.require_group(gname);
-        group.write_attribute("dataset", reader->dataset_name());
-        group.write_attribute("analysis", reader->current_analysis());
-        ff.save(group);
+        r.dataset = reader->dataset_name();
+        r.analysis = reader->current_analysis();
+        results[i].push_back(r);
       }
+    }
+  },
+                [&](size_t i, const path&)
+  {
+    std::cout << logs[i].str();
+    logs[i].str("");
 
+    //workers may still be reading other files
+    std::lock_guard<std::mutex> io(NMX::io_mutex());
+    for (auto &r : results[i])
+    {
+      H5CC::Group group = outfile.require_group(r.gname);
+      group.write_attribute("dataset", r.dataset);
+      group.write_attribute("analysis", r.analysis);
+      r.merits.save(group);
     }
-  }
+    results[i].clear();
+    return true;
+  });
 
   return 0;
 }
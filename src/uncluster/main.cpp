@@ -107,12 +107,13 @@ void cluster_eventlets(const path& file, int chunksize, int timesep)
   uint64_t eventlet_count {0};
   int64_t time_offset {0};
   ChronoQ chron(100);
+  EventletPacket ready(500);
 
   auto prog = progbar(nevents, "  Converting to '" + newname + "'  ");
   CustomTimer timer(true);
   for (size_t eventID = 0; eventID < nevents; ++eventID)
   {
-    auto event = reader->get_event(eventID);
+    auto event = reader->get_event(eventID, false);
 
     EventletPacket packet(500);
 
@@ -144,8 +145,9 @@ void cluster_eventlets(const path& file, int chunksize, int timesep)
 
     chron.push(packet);
 
-    while (chron.ready())
-      writer.write_eventlet(chron.pop());
+    chron.pop(ready);
+    writer.write_packet(ready);
+    ready.clear_and_keep_capacity();
 
     ++(*prog);
     if (term_flag)
@@ -154,6 +156,7 @@ void cluster_eventlets(const path& file, int chunksize, int timesep)
 
   while (!chron.empty())
     writer.write_eventlet(chron.pop());
+  writer.flush();
 
   cout << "Unclustered " << nevents << " events into " << eventlet_count << " eventlets\n";
   cout << "Processing time = " << timer.done() << "   secs/1000events=" << timer.s() / nevents * 1000 << "\n";
@@ -0,0 +1,107 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "APVBatch.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <tuple>
+
+using namespace NMX;
+
+static constexpr size_t strips {37};
+static constexpr size_t timebins {23};
+
+APVBatch random_batch(size_t events, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int16_t> samples(events * 2 * strips * timebins, 0);
+  for (size_t e = 0; e < events; ++e)
+  {
+    //some events stay empty
+    if (e % 7 == 3)
+      continue;
+    auto x = samples.begin() + e * 2 * strips * timebins;
+    auto y = x + strips * timebins;
+    for (auto s = x; s != y; ++s)
+      if (rng() % 3 == 0)
+        *s = int16_t(rng() % 700) - 150;
+    for (auto s = y; s != y + strips * timebins; ++s)
+      if (rng() % 5 == 0)
+        *s = int16_t(rng() % 500) - 50;
+  }
+  return APVBatch(0, strips, timebins, samples);
+}
+
+EventParams event_params(AnalysisLevel level, int16_t threshold,
+                         int16_t separation, bool suppress_negatives)
+{
+  PlaneParams plane;
+  plane.strip.threshold = plane.timebin.threshold = threshold;
+  plane.strip.min_peak_separation = plane.timebin.min_peak_separation = separation;
+  plane.suppress_negatives = suppress_negatives;
+  plane.level = level;
+  plane.analyzer = Plane::analyzer(level);
+
+  EventParams ret;
+  ret.x = ret.y = plane;
+  return ret;
+}
+
+std::vector<std::tuple<uint32_t, uint32_t, double>> points(const HistList2D& list)
+{
+  std::vector<std::tuple<uint32_t, uint32_t, double>> ret;
+  for (const auto& p : list)
+    ret.emplace_back(p.x, p.y, p.v);
+  return ret;
+}
+
+TEST(APVBatch, MatchesEventAnalysis) {
+  auto batch = random_batch(40, 3);
+  ASSERT_EQ(batch.size(), 40u);
+
+  size_t columns {0};
+  size_t maxima {0};
+  for (auto level : {AnalysisLevel::all, AnalysisLevel::reduced,
+                     AnalysisLevel::to_vmm})
+    for (int16_t threshold : {-10, 0, 150, 260})
+      for (int16_t separation : {0, 1, 2})
+        for (bool noneg : {false, true})
+        {
+          auto params = event_params(level, threshold, separation, noneg);
+          auto results = batch.analyze(params);
+          auto vmm_only = batch.analyze(params, false);
+          EXPECT_TRUE(vmm_only.metrics.empty());
+          ASSERT_EQ(results.offsets.size(), 2 * batch.size() + 1);
+
+          for (size_t i = 0; i < batch.size(); ++i)
+          {
+            auto event = batch.event(i);
+            event.analyze(params);
+            for (size_t p = 0; p < 2; ++p)
+            {
+              auto expected = points((p ? event.y() : event.x()).get_points("strip_vmm"));
+              EXPECT_EQ(expected, points(results.vmm_points(i, p)))
+                  << "event " << i << " plane " << p;
+              EXPECT_EQ(expected, points(vmm_only.vmm_points(i, p)));
+              maxima += expected.size();
+            }
+
+            if (level == AnalysisLevel::to_vmm)
+              continue;
+            for (size_t c = 0; c < results.schema->size(); ++c)
+            {
+              auto name = results.schema->name(c);
+              //drawn afresh on every analysis
+              if (name.find("random") != std::string::npos)
+                continue;
+              ASSERT_TRUE(Event::metric_schema()->contains(name)) << name;
+              EXPECT_EQ(event.metrics().get_value(name), results.metric(i, c))
+                  << name << " event " << i << " threshold " << threshold
+                  << " separation " << separation << " noneg " << noneg;
+              ++columns;
+            }
+          }
+        }
+
+  EXPECT_GT(columns, 1000u);
+  EXPECT_GT(maxima, 100u);
+}
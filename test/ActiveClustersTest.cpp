@@ -0,0 +1,104 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "ActiveClusters.h"
+#include <gtest/gtest.h>
+
+using namespace NMX;
+
+Eventlet make_eventlet(uint64_t time, uint16_t strip)
+{
+  Eventlet e;
+  e.time = time;
+  e.strip = strip;
+  e.adc = 100;
+  return e;
+}
+
+TEST(ActiveClusters, JoinAdjacent) {
+  MicroclusterPool pool(4, Microcluster(2));
+  ActiveClusters c(pool, 10, 5);
+  EXPECT_FALSE(c.join(make_eventlet(0, 100)));
+  c.open(make_eventlet(0, 100));
+  EXPECT_TRUE(c.join(make_eventlet(3, 104)));
+  EXPECT_FALSE(c.join(make_eventlet(4, 200)));
+  c.open(make_eventlet(4, 200));
+  EXPECT_EQ(c.size(), 2u);
+
+  ActiveClusters::Retired retired;
+  c.retire_all(retired);
+  EXPECT_TRUE(c.empty());
+  ASSERT_EQ(retired.size(), 2u);
+  EXPECT_EQ(retired.begin()->second.size(), 2u);
+  EXPECT_EQ(retired.begin()->second.strip_end, 104);
+}
+
+TEST(ActiveClusters, MergeBridged) {
+  MicroclusterPool pool(4, Microcluster(2));
+  ActiveClusters c(pool, 10, 5);
+  c.open(make_eventlet(0, 100));
+  c.open(make_eventlet(1, 110));
+  EXPECT_EQ(c.size(), 2u);
+  EXPECT_TRUE(c.join(make_eventlet(2, 105)));
+  EXPECT_EQ(c.size(), 1u);
+
+  ActiveClusters::Retired retired;
+  c.retire_all(retired);
+  ASSERT_EQ(retired.size(), 1u);
+  EXPECT_EQ(retired.begin()->second.size(), 3u);
+  EXPECT_EQ(retired.begin()->second.strip_start, 100);
+  EXPECT_EQ(retired.begin()->second.strip_end, 110);
+}
+
+TEST(ActiveClusters, RetireInOrder) {
+  MicroclusterPool pool(4, Microcluster(2));
+  ActiveClusters c(pool, 10, 5);
+  c.open(make_eventlet(0, 100));
+  c.open(make_eventlet(5, 300));
+  c.open(make_eventlet(20, 500));
+
+  ActiveClusters::Retired retired;
+  EXPECT_FALSE(c.retire(10, retired));
+  EXPECT_TRUE(c.retire(11, retired));
+  EXPECT_EQ(retired.size(), 1u);
+  EXPECT_TRUE(c.retire(16, retired));
+  EXPECT_EQ(retired.size(), 2u);
+  EXPECT_EQ(c.size(), 1u);
+  EXPECT_FALSE(c.join(make_eventlet(16, 300)));
+}
+
+TEST(ActiveClusters, NotPastExpired) {
+  MicroclusterPool pool(4, Microcluster(2));
+  ActiveClusters c(pool, 10, 5);
+  c.open(make_eventlet(0, 100));
+  c.open(make_eventlet(8, 300));
+  EXPECT_TRUE(c.join(make_eventlet(10, 300)));
+
+  //first cluster has expired, later ones are not joined until it is retired
+  EXPECT_FALSE(c.join(make_eventlet(15, 300)));
+  EXPECT_EQ(c.size(), 2u);
+  ActiveClusters::Retired retired;
+  EXPECT_TRUE(c.retire(15, retired));
+  EXPECT_EQ(retired.size(), 1u);
+  EXPECT_TRUE(c.join(make_eventlet(15, 300)));
+}
+
+TEST(ActiveClusters, StorageReturned) {
+  MicroclusterPool pool(1, Microcluster(2));
+  {
+    ActiveClusters c(pool, 10, 5);
+    for (uint16_t s = 0; s < 5; ++s)
+      c.open(make_eventlet(s, s * 100));
+    EXPECT_TRUE(c.join(make_eventlet(5, 101)));
+    EXPECT_TRUE(c.join(make_eventlet(5, 102)));
+    EXPECT_EQ(pool.size(), 5u);
+    EXPECT_EQ(pool.free(), 0u);
+
+    ActiveClusters::Retired retired;
+    EXPECT_TRUE(c.retire(14, retired));
+    EXPECT_EQ(retired.size(), 1u);
+    EXPECT_EQ(pool.free(), 0u);
+    retired.clear();
+    EXPECT_EQ(pool.free(), 1u);
+  }
+  EXPECT_EQ(pool.free(), pool.size());
+}
@@ -0,0 +1,88 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "ChronoQ.h"
+#include <gtest/gtest.h>
+
+using namespace NMX;
+
+Eventlet chrono_eventlet(uint64_t time, uint16_t strip, uint16_t adc = 1)
+{
+  Eventlet e;
+  e.time = time;
+  e.strip = strip;
+  e.adc = adc;
+  return e;
+}
+
+TEST(ChronoQ, OrderTimeStripArrival) {
+  ChronoQ q(10);
+  EventletPacket p;
+  p.add(chrono_eventlet(105, 3));
+  p.add(chrono_eventlet(100, 7));
+  p.add(chrono_eventlet(105, 1, 1));
+  p.add(chrono_eventlet(105, 1, 2));
+  p.add(chrono_eventlet(100000, 0));
+  p.add(chrono_eventlet(102, 2));
+  q.push(p);
+  EXPECT_EQ(q.size(), 6u);
+
+  std::vector<Eventlet> out;
+  while (!q.empty())
+    out.push_back(q.pop());
+  ASSERT_EQ(out.size(), 6u);
+  EXPECT_EQ(out[0].time, 100u);
+  EXPECT_EQ(out[1].time, 102u);
+  EXPECT_EQ(out[2].strip, 1);
+  EXPECT_EQ(out[2].adc, 1);
+  EXPECT_EQ(out[3].adc, 2);
+  EXPECT_EQ(out[4].strip, 3);
+  EXPECT_EQ(out[5].time, 100000u);
+}
+
+TEST(ChronoQ, ReadyBehindLatest) {
+  ChronoQ q(10);
+  EventletPacket p;
+  p.add(chrono_eventlet(100, 0));
+  p.add(chrono_eventlet(101, 0));
+  q.push(p);
+  EXPECT_FALSE(q.ready());
+
+  EventletPacket later;
+  later.add(chrono_eventlet(150, 0));
+  later.add(chrono_eventlet(140, 5));
+  q.push(later);
+  ASSERT_TRUE(q.ready());
+  EXPECT_EQ(q.pop().time, 100u);
+
+  EventletPacket batch;
+  EXPECT_EQ(q.pop(batch), 1u);
+  ASSERT_EQ(batch.eventlets.size(), 1u);
+  EXPECT_EQ(batch.time_start, 101u);
+  EXPECT_FALSE(q.ready());
+  EXPECT_EQ(q.size(), 2u);
+
+  EventletPacket last;
+  last.add(chrono_eventlet(200, 0));
+  q.push(last);
+  EXPECT_EQ(q.pop(batch), 2u);
+  EXPECT_EQ(batch.eventlets.size(), 3u);
+  EXPECT_EQ(batch.time_end, 150u);
+}
+
+TEST(ChronoQ, RingRestart) {
+  ChronoQ q(1);
+  for (uint64_t t : {5000000u, 10u, 20000u})
+  {
+    EventletPacket p;
+    p.add(chrono_eventlet(t, 0));
+    q.push(p);
+  }
+  EXPECT_EQ(q.pop().time, 10u);
+  EXPECT_EQ(q.pop().time, 20000u);
+  EventletPacket p;
+  p.add(chrono_eventlet(15, 0));
+  q.push(p);
+  EXPECT_EQ(q.pop().time, 15u);
+  EXPECT_EQ(q.pop().time, 5000000u);
+  EXPECT_TRUE(q.empty());
+}
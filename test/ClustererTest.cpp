@@ -0,0 +1,171 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "Clusterer.h"
+#include "Segmenter.h"
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace NMX;
+
+std::vector<Eventlet> random_eventlets(size_t count, int tracks, unsigned seed)
+{
+  std::mt19937 rng(seed);
+  std::vector<int> centers(tracks);
+  for (auto &c : centers)
+    c = rng() % 1280;
+  std::vector<Eventlet> ret;
+  uint64_t time {1000};
+  for (size_t i = 0; i < count; ++i)
+  {
+    Eventlet e;
+    time += (rng() % 8 == 0) ? rng() % 50 : 0;
+    int k = rng() % tracks;
+    if (rng() % 50 == 0)
+      centers[k] = rng() % 1280;
+    e.time = time;
+    e.strip = std::max(0, std::min(1279, centers[k] + int(rng() % 3) - 1));
+    e.plane = rng() % 2;
+    e.adc = 1 + rng() % 1000;
+    ret.push_back(e);
+  }
+  return ret;
+}
+
+TEST(Clusterer, CorrelatesPlanes) {
+  Clusterer c(10, 5, 3);
+  Eventlet e;
+  e.adc = 100;
+  for (uint64_t t = 0; t < 4; ++t)
+  {
+    e.time = t;
+    e.plane = t % 2;
+    e.strip = 100 + t;
+    c.insert(e);
+  }
+  e.time = 50;
+  c.insert(e);
+  ASSERT_TRUE(c.events_ready());
+  auto events = c.pop_events();
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events.front().x_.entries.size(), 2u);
+  EXPECT_EQ(events.front().y_.entries.size(), 2u);
+
+  c.dump();
+  EXPECT_EQ(c.pop_events().size(), 1u);
+  EXPECT_TRUE(c.empty());
+}
+
+TEST(Clusterer, BoundDefersEvents) {
+  auto eventlets = random_eventlets(50000, 20, 1);
+  Clusterer unbounded(28, 18, 3);
+  Clusterer bounded(28, 18, 3, 1);
+
+  std::list<SimpleEvent> a, b;
+  size_t most {0};
+  for (const auto &e : eventlets)
+  {
+    unbounded.insert(e);
+    auto ready = unbounded.pop_events();
+    most = std::max(most, ready.size());
+    a.splice(a.end(), ready);
+    bounded.insert(e);
+    auto events = bounded.pop_events();
+    ASSERT_LE(events.size(), 1u);
+    b.splice(b.end(), events);
+  }
+  unbounded.dump();
+  a.splice(a.end(), unbounded.pop_events());
+  bounded.dump();
+  b.splice(b.end(), bounded.pop_events());
+  EXPECT_TRUE(bounded.empty());
+  //some inserts must have had more events to form than the bound
+  EXPECT_GT(most, 1u);
+
+  ASSERT_GT(a.size(), 100u);
+  ASSERT_EQ(a.size(), b.size());
+  for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+  {
+    ASSERT_EQ(i->x_.entries.size(), j->x_.entries.size());
+    ASSERT_EQ(i->y_.entries.size(), j->y_.entries.size());
+    for (size_t k = 0; k < i->x_.entries.size(); ++k)
+      ASSERT_EQ(i->x_.entries[k].time, j->x_.entries[k].time);
+  }
+}
+
+bool same_entries(const SimplePlane& a, const SimplePlane& b)
+{
+  if (a.entries.size() != b.entries.size())
+    return false;
+  for (size_t i = 0; i < a.entries.size(); ++i)
+    if ((a.entries[i].time != b.entries[i].time) ||
+        (a.entries[i].strip != b.entries[i].strip) ||
+        (a.entries[i].adc != b.entries[i].adc))
+      return false;
+  return true;
+}
+
+TEST(Clusterer, SegmentsMatchSerial) {
+  auto eventlets = random_eventlets(60000, 20, 2);
+  std::mt19937 rng(7);
+  for (auto &e : eventlets)
+  {
+    //ignored by the clusterer
+    if (rng() % 97 == 0)
+      e.adc = 0;
+    //later than any ordering latency
+    else if (rng() % 211 == 0)
+      e.time -= 300 + rng() % 300;
+  }
+
+  Clusterer serial(28, 18, 3);
+  std::list<SimpleEvent> expected;
+  for (const auto &e : eventlets)
+  {
+    serial.insert(e);
+    expected.splice(expected.end(), serial.pop_events());
+  }
+  serial.dump();
+  expected.splice(expected.end(), serial.pop_events());
+  ASSERT_GT(expected.size(), 100u);
+
+  for (size_t segment_size : {1, 300, 5000})
+  {
+    Segmenter segmenter(28, segment_size);
+    Clusterer clusterer(28, 18, 3);
+    std::list<SimpleEvent> events;
+    size_t segments {0};
+    for (size_t i = 0; i < eventlets.size(); i += 500)
+    {
+      EventletPacket packet(500);
+      for (size_t j = i; j < std::min(i + 500, eventlets.size()); ++j)
+        packet.add(eventlets[j]);
+      auto parts = segmenter.split(std::move(packet));
+      for (size_t p = 0; p < parts.size(); ++p)
+      {
+        for (const auto &e : parts[p].eventlets)
+        {
+          clusterer.insert(e);
+          events.splice(events.end(), clusterer.pop_events());
+        }
+        //every segment is clustered on its own
+        if (p + 1 < parts.size())
+        {
+          clusterer.dump();
+          events.splice(events.end(), clusterer.pop_events());
+          segments++;
+        }
+      }
+    }
+    clusterer.dump();
+    events.splice(events.end(), clusterer.pop_events());
+
+    EXPECT_GT(segments, 10u) << segment_size;
+    ASSERT_EQ(events.size(), expected.size()) << segment_size;
+    auto j = events.begin();
+    for (auto i = expected.begin(); i != expected.end(); ++i, ++j)
+    {
+      ASSERT_TRUE(same_entries(i->x_, j->x_)) << segment_size;
+      ASSERT_TRUE(same_entries(i->y_, j->y_)) << segment_size;
+    }
+  }
+}
@@ -0,0 +1,105 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "CompactBlock.h"
+#include <gtest/gtest.h>
+
+using namespace NMX;
+
+std::vector<Eventlet> make_eventlets()
+{
+  std::vector<Eventlet> ret;
+  for (uint64_t i = 0; i < 100; ++i)
+  {
+    Eventlet e;
+    e.time = 1000000000000 + i * 3 + (i % 7);
+    e.plane = i % 2;
+    e.strip = (i * 37) % 1280;
+    e.adc = (i * 101) % 1024;
+    e.flag = (i % 3) == 0;
+    e.over_threshold = (i % 5) == 0;
+    ret.push_back(e);
+  }
+  return ret;
+}
+
+void expect_equal(const Eventlet& a, const Eventlet& b)
+{
+  EXPECT_EQ(a.time, b.time);
+  EXPECT_EQ(a.plane, b.plane);
+  EXPECT_EQ(a.strip, b.strip);
+  EXPECT_EQ(a.adc, b.adc);
+  EXPECT_EQ(a.flag, b.flag);
+  EXPECT_EQ(a.over_threshold, b.over_threshold);
+}
+
+TEST(CompactBlock, RoundTrip) {
+  auto in = make_eventlets();
+  std::vector<uint32_t> stream;
+  auto block = CompactBlock::encode(in.data(), in.size(), 0, stream);
+  ASSERT_EQ(block.count, in.size());
+  ASSERT_EQ(block.word_count(), stream.size());
+  ASSERT_LT(stream.size(), in.size());
+
+  std::vector<Eventlet> out;
+  block.decode(stream.data(), 0, in.size(), out);
+  ASSERT_EQ(out.size(), in.size());
+  for (size_t i = 0; i < in.size(); ++i)
+    expect_equal(in[i], out[i]);
+}
+
+TEST(CompactBlock, UnsortedTimes) {
+  auto in = make_eventlets();
+  std::swap(in[10], in[50]);
+  in[20].time = 0;
+  in[30].time = std::numeric_limits<uint64_t>::max();
+  std::vector<uint32_t> stream;
+  auto block = CompactBlock::encode(in.data(), in.size(), 0, stream);
+
+  std::vector<Eventlet> out;
+  block.decode(stream.data(), 0, in.size(), out);
+  ASSERT_EQ(out.size(), in.size());
+  for (size_t i = 0; i < in.size(); ++i)
+    expect_equal(in[i], out[i]);
+}
+
+TEST(CompactBlock, PartialDecode) {
+  auto in = make_eventlets();
+  std::vector<uint32_t> stream(5, 0);
+  auto block = CompactBlock::encode(in.data(), in.size(), 200, stream);
+  ASSERT_EQ(block.word_offset, 5u);
+  ASSERT_EQ(block.end_row(), 300u);
+
+  std::vector<Eventlet> out;
+  block.decode(stream.data() + block.word_offset, 40, 25, out);
+  ASSERT_EQ(out.size(), 25u);
+  for (size_t i = 0; i < out.size(); ++i)
+    expect_equal(in[40 + i], out[i]);
+
+  out.clear();
+  block.decode(stream.data() + block.word_offset, 90, 25, out);
+  ASSERT_EQ(out.size(), 10u);
+}
+
+TEST(CompactBlock, Descriptor) {
+  auto in = make_eventlets();
+  std::vector<uint32_t> stream;
+  auto block = CompactBlock::encode(in.data(), in.size(), 7, stream);
+
+  std::vector<uint64_t> row;
+  block.to_h5(row);
+  ASSERT_EQ(row.size(), 4u);
+  auto copy = CompactBlock::from_h5(row.data());
+  ASSERT_EQ(copy.first_row, block.first_row);
+  ASSERT_EQ(copy.first_time, block.first_time);
+  ASSERT_EQ(copy.word_offset, block.word_offset);
+  ASSERT_EQ(copy.count, block.count);
+  ASSERT_EQ(copy.bits_per_eventlet(), block.bits_per_eventlet());
+}
+
+TEST(CompactBlock, Empty) {
+  std::vector<uint32_t> stream;
+  auto block = CompactBlock::encode(nullptr, 0, 0, stream);
+  ASSERT_EQ(block.count, 0u);
+  ASSERT_EQ(block.word_count(), 0u);
+  ASSERT_TRUE(stream.empty());
+}
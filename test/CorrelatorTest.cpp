@@ -0,0 +1,120 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "Correlator.h"
+#include <gtest/gtest.h>
+#include <limits>
+
+using namespace NMX;
+
+Eventlet make_plane_eventlet(uint64_t time, uint16_t strip, uint8_t plane)
+{
+  Eventlet e;
+  e.time = time;
+  e.strip = strip;
+  e.plane = plane;
+  e.adc = 100;
+  return e;
+}
+
+TEST(PlaneClusterer, RetireOnOpen) {
+  PlaneClusterer c(10, 5);
+  c.insert(make_plane_eventlet(0, 100, 0));
+  c.insert(make_plane_eventlet(2, 102, 0));
+  EXPECT_EQ(c.watermark(), 0u);
+
+  RetiredClusters retired;
+  c.pop(retired);
+  EXPECT_TRUE(retired.ends.empty());
+
+  c.insert(make_plane_eventlet(20, 300, 0));
+  c.pop(retired);
+  ASSERT_EQ(retired.ends.size(), 1u);
+  EXPECT_EQ(retired.ends[0], 2u);
+  EXPECT_EQ(retired.eventlets[1].strip, 102);
+  EXPECT_EQ(retired.watermark, 20u);
+
+  c.advance(25);
+  EXPECT_EQ(c.watermark(), 20u);
+
+  c.dump();
+  c.pop(retired);
+  ASSERT_EQ(retired.ends.size(), 1u);
+  EXPECT_EQ(retired.watermark, std::numeric_limits<uint64_t>::max());
+}
+
+TEST(PlaneClusterer, AdvanceWhileQuiet) {
+  PlaneClusterer c(10, 5);
+  EXPECT_EQ(c.watermark(), 0u);
+  c.advance(50);
+  EXPECT_EQ(c.watermark(), 50u);
+}
+
+TEST(Correlator, WaitsForWatermark) {
+  PlaneClusterer x(10, 5);
+  PlaneClusterer y(10, 5);
+  Correlator c(10, 5);
+
+  x.insert(make_plane_eventlet(0, 100, 0));
+  x.insert(make_plane_eventlet(3, 101, 0));
+  x.insert(make_plane_eventlet(30, 100, 0));
+  RetiredClusters retired;
+  x.pop(retired);
+  c.add(retired);
+
+  //y could still retire an overlapping cluster
+  c.correlate(std::min(x.watermark(), y.watermark()));
+  EXPECT_FALSE(c.events_ready());
+
+  y.insert(make_plane_eventlet(2, 200, 1));
+  y.insert(make_plane_eventlet(30, 200, 1));
+  y.pop(retired);
+  c.add(retired);
+  EXPECT_EQ(c.size(), 2u);
+
+  c.correlate(std::min(x.watermark(), y.watermark()));
+  ASSERT_TRUE(c.events_ready());
+  auto events = c.pop_events();
+  ASSERT_EQ(events.size(), 1u);
+  EXPECT_EQ(events.front().x_.entries.size(), 2u);
+  EXPECT_EQ(events.front().y_.entries.size(), 1u);
+  EXPECT_TRUE(c.empty());
+}
+
+TEST(Correlator, PlaneOrderIrrelevant) {
+  RetiredClusters xs, ys;
+  {
+    PlaneClusterer x(10, 5);
+    PlaneClusterer y(10, 5);
+    for (uint64_t t = 0; t < 200; t += 7)
+    {
+      x.insert(make_plane_eventlet(t, 100 + t % 13, 0));
+      y.insert(make_plane_eventlet(t + t % 3, 400 + t % 11, 1));
+      if (t % 5 == 0)
+        x.insert(make_plane_eventlet(t + 1, 600, 0));
+    }
+    x.dump();
+    y.dump();
+    x.pop(xs);
+    y.pop(ys);
+  }
+
+  Correlator a(10, 5);
+  a.add(xs);
+  a.add(ys);
+  a.dump();
+  Correlator b(10, 5);
+  b.add(ys);
+  b.add(xs);
+  b.dump();
+
+  auto ea = a.pop_events();
+  auto eb = b.pop_events();
+  ASSERT_EQ(ea.size(), eb.size());
+  for (auto i = ea.begin(), j = eb.begin(); i != ea.end(); ++i, ++j)
+  {
+    ASSERT_EQ(i->x_.entries.size(), j->x_.entries.size());
+    ASSERT_EQ(i->y_.entries.size(), j->y_.entries.size());
+    for (size_t k = 0; k < i->x_.entries.size(); ++k)
+      EXPECT_EQ(i->x_.entries[k].time, j->x_.entries[k].time);
+  }
+}
@@ -0,0 +1,70 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "MergeQ.h"
+#include <gtest/gtest.h>
+
+using namespace NMX;
+
+EventletPacket merge_packet(std::initializer_list<std::pair<uint64_t, uint16_t>> list)
+{
+  EventletPacket ret;
+  uint16_t adc {1};
+  for (auto p : list)
+  {
+    Eventlet e;
+    e.time = p.first;
+    e.strip = p.second;
+    e.adc = adc++;
+    ret.add(e);
+  }
+  return ret;
+}
+
+TEST(MergeQ, SortsPacket) {
+  MergeQ q(0);
+  q.push(merge_packet({{12, 1}, {10, 5}, {10, 2}, {11, 0}, {10, 2}}));
+  EXPECT_EQ(q.size(), 5u);
+  EXPECT_FALSE(q.ready());
+
+  std::vector<Eventlet> out;
+  while (!q.empty())
+    out.push_back(q.pop());
+  ASSERT_EQ(out.size(), 5u);
+  EXPECT_EQ(out[0].adc, 3);
+  EXPECT_EQ(out[1].adc, 5);
+  EXPECT_EQ(out[2].adc, 2);
+  EXPECT_EQ(out[3].adc, 4);
+  EXPECT_EQ(out[4].adc, 1);
+}
+
+TEST(MergeQ, SortsWidePacket) {
+  MergeQ q(0);
+  q.push(merge_packet({{1000, 0}, {10, 0}, {500, 3}, {500, 1}}));
+  std::vector<uint64_t> times;
+  while (!q.empty())
+    times.push_back(q.pop().time);
+  EXPECT_EQ(times, std::vector<uint64_t>({10, 500, 500, 1000}));
+}
+
+TEST(MergeQ, MergesByLatency) {
+  MergeQ q(5);
+  q.push(merge_packet({{100, 0}, {104, 0}, {110, 0}}));
+  q.push(merge_packet({{103, 1}, {104, 0}, {107, 0}}));
+  EXPECT_FALSE(q.ready());
+
+  q.push(merge_packet({{109, 0}, {120, 0}}));
+  EventletPacket ready;
+  EXPECT_EQ(q.pop(ready), 2u);
+  ASSERT_EQ(ready.eventlets.size(), 2u);
+  EXPECT_EQ(ready.eventlets[0].time, 100u);
+  EXPECT_EQ(ready.eventlets[1].time, 103u);
+  EXPECT_EQ(q.size(), 6u);
+
+  q.push(merge_packet({{130, 0}}));
+  std::vector<uint16_t> adcs;
+  while (q.ready())
+    adcs.push_back(q.pop().adc);
+  //equal time and strip come out in order of arrival
+  EXPECT_EQ(adcs, std::vector<uint16_t>({2, 2, 3, 1, 3, 2}));
+  EXPECT_EQ(q.size(), 1u);
+}
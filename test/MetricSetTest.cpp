@@ -0,0 +1,110 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "MetricSet.h"
+#include <gtest/gtest.h>
+
+using namespace NMX;
+
+std::shared_ptr<const MetricSchema> make_schema()
+{
+  auto ret = std::make_shared<MetricSchema>();
+  ret->add("b", "second");
+  ret->add("a", "first");
+  ret->add("c", "third");
+  return ret;
+}
+
+TEST(MetricSchema, Ids) {
+  MetricSchema s;
+  EXPECT_EQ(s.add("x", "ex"), 0u);
+  EXPECT_EQ(s.add("y"), 1u);
+  EXPECT_EQ(s.add("x", "other"), 0u);
+  EXPECT_EQ(s.size(), 2u);
+  EXPECT_TRUE(s.contains("y"));
+  EXPECT_FALSE(s.contains("z"));
+  EXPECT_EQ(s.id("z"), s.size());
+  EXPECT_EQ(s.name(1), "y");
+  EXPECT_EQ(s.description(0), "ex");
+  s.describe(1, "why");
+  EXPECT_EQ(s.description(1), "why");
+}
+
+TEST(MetricSet, SetById) {
+  auto schema = make_schema();
+  MetricSet m(schema);
+  EXPECT_EQ(m.size(), 0u);
+  m.set(2, 3.5);
+  EXPECT_TRUE(m.has(2));
+  EXPECT_FALSE(m.has(0));
+  EXPECT_FALSE(m.has(10));
+  EXPECT_EQ(m.value(2), 3.5);
+  EXPECT_EQ(m.value(0), 0);
+  EXPECT_EQ(m.get_value("c"), 3.5);
+  EXPECT_EQ(m.get("c").description, "third");
+  EXPECT_EQ(m.size(), 1u);
+  EXPECT_EQ(&m.schema(), schema.get());
+}
+
+TEST(MetricSet, DataSortedByName) {
+  MetricSet m(make_schema());
+  m.set(0, 2);
+  m.set(1, 1);
+  auto d = m.data();
+  ASSERT_EQ(d.size(), 2u);
+  EXPECT_EQ(d.begin()->first, "a");
+  EXPECT_EQ(d.begin()->second.value, 1);
+  EXPECT_EQ(d.rbegin()->first, "b");
+}
+
+TEST(MetricSet, NewNameCopiesSchema) {
+  auto schema = make_schema();
+  MetricSet m(schema);
+  m.set("a", MetricVal(1, "first"));
+  EXPECT_EQ(&m.schema(), schema.get());
+
+  m.set("d", MetricVal(4, "fourth"));
+  EXPECT_NE(&m.schema(), schema.get());
+  EXPECT_EQ(schema->size(), 3u);
+  EXPECT_EQ(m.schema().id("a"), schema->id("a"));
+  EXPECT_EQ(m.get("d").description, "fourth");
+
+  MetricSet copy = m;
+  copy.set("e", 5);
+  EXPECT_FALSE(m.schema().contains("e"));
+  EXPECT_TRUE(copy.schema().contains("e"));
+  EXPECT_EQ(copy.get_value("d"), 4);
+}
+
+TEST(MetricSet, NewDescriptionCopiesSchema) {
+  auto schema = make_schema();
+  MetricSet m(schema);
+  m.set("a", MetricVal(1, "changed"));
+  EXPECT_EQ(m.get("a").description, "changed");
+  EXPECT_EQ(schema->description(schema->id("a")), "first");
+}
+
+TEST(MetricSet, Retain) {
+  MetricSet m(make_schema());
+  m.set(0, 1);
+  m.set(1, 2);
+  m.set(2, 3);
+  m.retain({2, 0, 7});
+  EXPECT_EQ(m.size(), 2u);
+  EXPECT_TRUE(m.has(0));
+  EXPECT_FALSE(m.has(1));
+  EXPECT_TRUE(m.has(2));
+  m.clear();
+  EXPECT_EQ(m.size(), 0u);
+}
+
+TEST(MetricSet, MergeAndPrefix) {
+  MetricSet x(make_schema());
+  x.set(1, 7);
+  MetricSet e;
+  e.merge(x, "x.");
+  EXPECT_EQ(e.get_value("x.a"), 7);
+  EXPECT_EQ(e.get("x.a").description, "first");
+  auto back = e.with_prefix("x.");
+  EXPECT_EQ(back.get_value("a"), 7);
+  EXPECT_EQ(e.with_names({"x.a", "x.b"}).size(), 1u);
+}
@@ -46,3 +46,18 @@ TEST(MicroclusterPool, RequisitionCycle) {
   ASSERT_EQ(m.requisition(), 4);
   ASSERT_FALSE(m.free());
 }
+
+TEST(MicroclusterPool, RequisitionOrGrow) {
+  MicroclusterPool m(2, Microcluster(12));
+  ASSERT_EQ(m.requisition_or_grow(), 0);
+  ASSERT_EQ(m.requisition_or_grow(), 1);
+  ASSERT_FALSE(m.free());
+
+  ASSERT_EQ(m.requisition_or_grow(), 2);
+  ASSERT_EQ(m.size(), 3);
+  ASSERT_EQ(m[2].reserved_size(), 12);
+
+  m.release(1);
+  ASSERT_EQ(m.requisition_or_grow(), 1);
+  ASSERT_EQ(m.size(), 3);
+}
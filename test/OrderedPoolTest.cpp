@@ -0,0 +1,96 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "OrderedPool.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST(OrderedPool, FinishesInOrder) {
+  for (size_t threads : {0, 1, 2, 5})
+  {
+    size_t window {6};
+    std::vector<size_t> slots(window, 0);
+    std::vector<size_t> prepared, finished;
+    std::atomic<size_t> in_flight {0};
+    std::atomic<size_t> max_in_flight {0};
+
+    for_each_in_order(10, 110, threads, window,
+                      [&](size_t i)
+                      {
+                        prepared.push_back(i);
+                        slots[i % window] = i;
+                        size_t n = ++in_flight;
+                        if (n > max_in_flight)
+                          max_in_flight = n;
+                      },
+                      [&](size_t i)
+                      {
+                        EXPECT_EQ(slots[i % window], i);
+                        slots[i % window] = 2 * i;
+                      },
+                      [&](size_t i)
+                      {
+                        EXPECT_EQ(slots[i % window], 2 * i);
+                        finished.push_back(i);
+                        --in_flight;
+                        return true;
+                      });
+
+    ASSERT_EQ(finished.size(), 100u) << threads << " threads";
+    for (size_t i = 0; i < finished.size(); ++i)
+    {
+      EXPECT_EQ(prepared[i], i + 10);
+      EXPECT_EQ(finished[i], i + 10);
+    }
+    EXPECT_LE(max_in_flight, window);
+  }
+}
+
+TEST(OrderedPool, FinishStops) {
+  for (size_t threads : {1, 4})
+  {
+    std::atomic<size_t> processed {0};
+    size_t last {0};
+    for_each_in_order(0, 1000, threads, 8, nullptr,
+                      [&](size_t) { ++processed; },
+                      [&](size_t i) { last = i; return i < 20; });
+    EXPECT_EQ(last, 20u);
+    EXPECT_LT(processed, 30u);
+  }
+}
+
+TEST(OrderedPool, FailuresRethrown) {
+  for (size_t threads : {1, 4})
+  {
+    EXPECT_THROW(for_each_in_order(0, 100, threads, 8,
+                                   [&](size_t i)
+                                   {
+                                     if (i == 30)
+                                       throw std::runtime_error("prepare");
+                                   },
+                                   [&](size_t) {}, nullptr),
+                 std::runtime_error);
+
+    EXPECT_THROW(for_each_in_order(0, 100, threads, 8, nullptr,
+                                   [&](size_t i)
+                                   {
+                                     if (i == 40)
+                                       throw std::runtime_error("process");
+                                   },
+                                   nullptr),
+                 std::runtime_error);
+
+    size_t finished {0};
+    EXPECT_THROW(for_each_in_order(0, 100, threads, 8, nullptr,
+                                   [&](size_t) {},
+                                   [&](size_t i) -> bool
+                                   {
+                                     if (i == 50)
+                                       throw std::runtime_error("finish");
+                                     return ++finished;
+                                   }),
+                 std::runtime_error);
+    EXPECT_EQ(finished, 50u);
+  }
+}
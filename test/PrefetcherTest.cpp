@@ -0,0 +1,57 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "Prefetcher.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace NMX;
+
+class CountingRaw : public Raw
+{
+public:
+  CountingRaw(size_t count, size_t bad)
+    : count_(count), bad_(bad) {}
+
+  size_t event_count() const override { return count_; }
+
+  Event get_event(size_t index) const override
+  {
+    if (index == bad_)
+      throw std::runtime_error("unreadable event " + std::to_string(index));
+    Plane x;
+    x.add_strip(0, Strip(std::vector<int16_t>{int16_t(index + 1)}));
+    return Event(x, Plane());
+  }
+
+  void write_event(size_t, const Event&) override {}
+
+private:
+  size_t count_;
+  size_t bad_;
+};
+
+int16_t value(const Event& event)
+{
+  return int16_t(event.x().get_points().front().v);
+}
+
+TEST(Prefetcher, SequentialAndJump) {
+  Prefetcher prefetcher(std::make_shared<CountingRaw>(200, 1000), 8);
+  for (size_t i = 0; i < 50; ++i)
+    ASSERT_EQ(value(prefetcher.get_event(i)), int16_t(i + 1));
+  for (size_t i = 120; i < 200; ++i)
+    ASSERT_EQ(value(prefetcher.get_event(i)), int16_t(i + 1));
+  EXPECT_EQ(value(prefetcher.get_event(7)), 8);
+  EXPECT_TRUE(prefetcher.get_event(500).empty());
+}
+
+TEST(Prefetcher, ReadFailureRethrown) {
+  Prefetcher prefetcher(std::make_shared<CountingRaw>(100, 20), 8);
+  for (size_t i = 0; i < 20; ++i)
+    ASSERT_EQ(value(prefetcher.get_event(i)), int16_t(i + 1));
+  EXPECT_THROW(prefetcher.get_event(20), std::runtime_error);
+
+  //later events are still readable after a jump
+  EXPECT_EQ(value(prefetcher.get_event(21)), 22);
+  EXPECT_EQ(value(prefetcher.get_event(22)), 23);
+}
@@ -0,0 +1,92 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "SPSCQueue.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+using namespace NMX;
+
+TEST(SPSCQueue, Capacity) {
+  SPSCQueue<int> q(5);
+  EXPECT_EQ(q.capacity(), 8u);
+  for (int i = 0; i < 8; ++i)
+    EXPECT_TRUE(q.try_push(i));
+  int item = 8;
+  EXPECT_FALSE(q.try_push(item));
+  EXPECT_EQ(q.size(), 8u);
+  EXPECT_EQ(q.max_depth(), 8u);
+
+  EXPECT_TRUE(q.try_pop(item));
+  EXPECT_EQ(item, 0);
+  EXPECT_EQ(q.size(), 7u);
+}
+
+TEST(SPSCQueue, CloseDrains) {
+  SPSCQueue<int> q(4);
+  q.push(1);
+  q.push(2);
+  q.close();
+  int item {0};
+  EXPECT_TRUE(q.pop(item));
+  EXPECT_EQ(item, 1);
+  EXPECT_TRUE(q.pop(item));
+  EXPECT_EQ(item, 2);
+  EXPECT_FALSE(q.pop(item));
+}
+
+TEST(SPSCQueue, Threaded) {
+  SPSCQueue<std::vector<int>> q(2);
+  int count = 20000;
+  std::thread producer([&]
+  {
+    for (int i = 0; i < count; ++i)
+      q.push(std::vector<int>(1 + i % 3, i));
+    q.close();
+  });
+
+  std::vector<int> item;
+  int expected {0};
+  while (q.pop(item))
+  {
+    ASSERT_EQ(item.size(), size_t(1 + expected % 3));
+    ASSERT_EQ(item.front(), expected);
+    expected++;
+  }
+  producer.join();
+  EXPECT_EQ(expected, count);
+  EXPECT_EQ(q.pushes(), size_t(count));
+  EXPECT_LE(q.max_depth(), 2u);
+}
+
+TEST(SPSCQueue, ParkedSidesWake) {
+  SPSCQueue<int> q(2);
+  int count = 200;
+  std::thread producer([&]
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      //consumer parks on an empty queue
+      if (i % 50 == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      q.push(int(i));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    q.close();
+  });
+
+  int item {0};
+  int expected {0};
+  while (q.pop(item))
+  {
+    ASSERT_EQ(item, expected);
+    //producer parks on a full queue
+    if (expected % 50 == 25)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    expected++;
+  }
+  producer.join();
+  EXPECT_EQ(expected, count);
+  EXPECT_GT(q.full_waits(), 0u);
+  EXPECT_GT(q.empty_waits(), 0u);
+}
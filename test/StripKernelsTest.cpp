@@ -0,0 +1,81 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "StripKernels.h"
+#include <gtest/gtest.h>
+
+using namespace NMX;
+
+std::vector<int16_t> make_samples(size_t n)
+{
+  std::vector<int16_t> ret;
+  for (size_t i = 0; i < n; ++i)
+    ret.push_back(((i * 37) % 23) * 20 - 60);
+  return ret;
+}
+
+bool bit(const std::vector<uint64_t>& bits, size_t i)
+{
+  return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+TEST(StripKernels, MaskAtLeast) {
+  for (size_t n : {0, 1, 7, 8, 9, 16, 33, 64, 65, 130})
+  {
+    auto data = make_samples(n);
+    std::vector<uint64_t> bits;
+    mask_at_least(data.data(), n, 100, bits);
+    ASSERT_EQ(bits.size(), (n + 63) / 64);
+    for (size_t i = 0; i < n; ++i)
+      EXPECT_EQ(bit(bits, i), data[i] >= 100);
+    if (n % 64)
+    {
+      EXPECT_EQ(bits.back() >> (n % 64), 0u);
+    }
+  }
+}
+
+TEST(StripKernels, MaskSlopes) {
+  for (size_t n : {0, 1, 2, 9, 17, 64, 65, 130})
+  {
+    auto data = make_samples(n);
+    if (n > 3)
+      data[2] = data[3];
+    std::vector<uint64_t> rises, falls;
+    mask_slopes(data.data(), n, rises, falls);
+    for (size_t i = 0; i + 1 < n; ++i)
+    {
+      EXPECT_EQ(bit(rises, i), data[i + 1] > data[i]);
+      EXPECT_EQ(bit(falls, i), data[i + 1] < data[i]);
+    }
+    if (n)
+    {
+      EXPECT_FALSE(bit(rises, n - 1));
+      EXPECT_FALSE(bit(falls, n - 1));
+    }
+  }
+}
+
+TEST(StripKernels, NextBit) {
+  std::vector<uint64_t> bits {0x8000000000000001, 0x2};
+  EXPECT_EQ(next_bit(bits, 100, 0, true), 0u);
+  EXPECT_EQ(next_bit(bits, 100, 1, true), 63u);
+  EXPECT_EQ(next_bit(bits, 100, 64, true), 65u);
+  EXPECT_EQ(next_bit(bits, 100, 66, true), 100u);
+  EXPECT_EQ(next_bit(bits, 100, 0, false), 1u);
+  EXPECT_EQ(next_bit(bits, 100, 63, false), 64u);
+  EXPECT_EQ(next_bit(bits, 66, 66, false), 66u);
+}
+
+TEST(StripKernels, LastArgmax) {
+  auto data = make_samples(100);
+  for (size_t start : {0, 5, 30})
+    for (size_t end : {40, 41, 60, 99})
+    {
+      size_t expected = start;
+      for (size_t i = start; i <= end; ++i)
+        if (data[i] >= data[expected])
+          expected = i;
+      EXPECT_EQ(last_argmax(data.data(), start, end), expected);
+    }
+  EXPECT_EQ(last_argmax(data.data(), 7, 7), 7u);
+}
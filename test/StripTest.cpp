@@ -0,0 +1,201 @@
+/** Copyright (C) 2017 European Spallation Source ERIC */
+
+#include "Strip.h"
+#include <gtest/gtest.h>
+#include <random>
+
+using namespace NMX;
+
+typedef std::map<uint16_t, int16_t> Tree;
+
+//straightforward scans over sparse samples, as Strip used to do them;
+//start is where the first value was added, not the lowest index
+struct Reference
+{
+  Tree tree;
+  int16_t start {-1};
+  int16_t end {-1};
+
+  void add_value(int16_t idx, int16_t val)
+  {
+    if ((idx < 0) || !val || tree.count(idx))
+      return;
+    tree[idx] = val;
+    if (start < 0)
+      start = idx;
+    if (idx > end)
+      end = idx;
+  }
+};
+
+std::vector<int16_t> as_vector(const Tree& tree)
+{
+  std::vector<int16_t> ret;
+  if (!tree.empty())
+  {
+    ret.resize(tree.rbegin()->first + 1);
+    for (auto d : tree)
+      ret[d.first] = d.second;
+  }
+  return ret;
+}
+
+Reference reference_maxima(const Tree& tree, int16_t threshold)
+{
+  Reference maxima;
+  auto data = as_vector(tree);
+  if (data.empty())
+    return maxima;
+  if ((data.size() > 1) && (data[0] > data[1]) && (data[0] >= threshold))
+    maxima.add_value(0, data[0]);
+  size_t last = data.size() - 1;
+  if ((data.size() > 1) && (data[last] > data[last - 1]) && (data[last] >= threshold))
+    maxima.add_value(last, data[last]);
+
+  bool ascended = false;
+  for (size_t i = 0; i < last; i++)
+  {
+    long diff = data[i + 1] - data[i];
+    if (diff > 0)
+      ascended = true;
+    if (diff < 0)
+    {
+      if (ascended && (data[i] >= threshold))
+        maxima.add_value(i, data[i]);
+      ascended = false;
+    }
+  }
+  return maxima;
+}
+
+Reference reference_vmm(const Tree& tree, int16_t threshold, int16_t over_threshold)
+{
+  std::vector<size_t> start, end;
+  bool over {false};
+  auto data = as_vector(tree);
+  for (size_t i = 0; i < data.size(); ++i)
+  {
+    if (!over && (data[i] >= threshold))
+    {
+      over = true;
+      start.push_back(i);
+    }
+    if (over && (data[i] < threshold))
+    {
+      over = false;
+      end.push_back(i - 1);
+    }
+  }
+  if (over)
+    end.push_back(data.size() - 1);
+
+  Reference vmm;
+  for (size_t i = 0; i < start.size(); ++i)
+  {
+    if ((int(end[i]) - int(start[i]) + 1) < over_threshold)
+      continue;
+    size_t max_bin = start[i];
+    for (size_t j = start[i]; j <= end[i]; ++j)
+      if (data[j] >= data[max_bin])
+        max_bin = j;
+    vmm.add_value(max_bin, data[max_bin]);
+  }
+  return vmm;
+}
+
+Reference reference_separation(const Tree& tree, int16_t min_separation)
+{
+  Reference ret;
+  int32_t prev {-1};
+  for (auto d : tree)
+  {
+    if ((prev == -1) || ((d.first - prev) > min_separation))
+      ret.add_value(d.first, d.second);
+    prev = d.first;
+  }
+  return ret;
+}
+
+Reference random_strip(std::mt19937& rng)
+{
+  Tree tree;
+  size_t size = rng() % 140;
+  size_t density = 1 + rng() % 4;
+  for (size_t i = 0; i < size; ++i)
+    if (rng() % density == 0)
+      tree[i] = int16_t(rng() % 600) - 100;
+  //plateaus and runs at threshold
+  if (size > 10)
+    for (size_t i = rng() % (size - 5), n = 0; n < 4; ++n)
+      tree[i + n] = 150;
+
+  Reference ret;
+  for (auto d : tree)
+    ret.add_value(d.first, d.second);
+  return ret;
+}
+
+void expect_matches(const Strip& strip, const Reference& expected)
+{
+  EXPECT_EQ(strip.as_tree(), expected.tree);
+  EXPECT_EQ(strip.num_valid(), int16_t(expected.tree.size()));
+  int64_t integral {0};
+  for (auto d : expected.tree)
+    integral += d.second;
+  EXPECT_EQ(strip.integral(), integral);
+  EXPECT_EQ(strip.empty(), expected.tree.empty());
+  EXPECT_EQ(strip.start(), expected.start);
+  EXPECT_EQ(strip.end(), expected.end);
+}
+
+TEST(Strip, MatchesReferenceScans) {
+  std::mt19937 rng(11);
+  size_t found {0};
+  for (size_t n = 0; n < 400; ++n)
+  {
+    auto reference = random_strip(rng);
+    Strip strip(reference.tree);
+    expect_matches(strip, reference);
+
+    for (int16_t threshold : {-20, 0, 1, 150, 151, 400})
+      for (int16_t over : {0, 1, 3, 5})
+        for (int16_t separation : {0, 1, 2, 4})
+        {
+          StripParams params;
+          params.threshold = threshold;
+          params.over_threshold = over;
+          params.min_peak_separation = separation;
+
+          auto maxima = reference_maxima(reference.tree, threshold);
+          auto vmm = reference_vmm(reference.tree, threshold, over);
+          auto separated = reference_separation(vmm.tree, separation);
+          SCOPED_TRACE(strip.debug() + " threshold=" + std::to_string(threshold)
+                       + " over=" + std::to_string(over)
+                       + " separation=" + std::to_string(separation));
+
+          expect_matches(strip.subset("maxima", params), maxima);
+          expect_matches(strip.subset("vmm", params), vmm);
+          expect_matches(strip.subset("vmm", params).subset("peak_separation", params),
+                         separated);
+          found += maxima.tree.size() + vmm.tree.size();
+        }
+
+    Reference positive;
+    for (auto d : reference.tree)
+      if (d.second > 0)
+        positive.add_value(d.first, d.second);
+    expect_matches(strip.suppress_negatives(), positive);
+  }
+  EXPECT_GT(found, 10000u);
+}
+
+TEST(Strip, DenseAndSparseAgree) {
+  std::mt19937 rng(5);
+  for (size_t n = 0; n < 100; ++n)
+  {
+    auto reference = random_strip(rng);
+    auto dense = as_vector(reference.tree);
+    dense.resize(dense.size() + rng() % 5, 0);
+    expect_matches(Strip(dense), reference);
+  }
+}